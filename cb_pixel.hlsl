@@ -1,10 +1,80 @@
+#if defined INSTANCE_VERTEX_BUFFER
+struct VSOutput
+{
+	float4 position : SV_POSITION;
+	nointerpolation float4 color : COLOR;
+};
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	return input.color;
+}
+#elif defined CB_ARRAY
+struct ObjectData
+{
+	float4 pos;
+	float4 color;
+};
+
+// Two float4s per entry, so the array has no padding between the elements.
+cbuffer Objects : register(b0)
+{
+	ObjectData objects[OBJECTS_PER_BUFFER];
+};
+
+cbuffer Draw : register(b1)
+{
+	uint object_idx;
+};
+
+float4 main() : SV_TARGET
+{
+	return objects[object_idx].color;
+}
+#else
+#if defined CB_PAYLOAD_HALF || defined CB_PAYLOAD_QUANTIZED
+cbuffer ConstantBuffer : register(b0)
+{
+	uint2 packed_pos;
+	uint packed_color;
+};
+
+// 8 bit unorm rgba, red in the lowest byte.
+float4 ObjectColor()
+{
+	return float4(packed_color & 0xff, (packed_color >> 8) & 0xff, (packed_color >> 16) & 0xff, packed_color >> 24) / 255.0f;
+}
+#else
 cbuffer ConstantBuffer : register(b0)
 {
 	float4 pos;
 	float4 color;
 };
 
+float4 ObjectColor()
+{
+	return color;
+}
+#endif
+
+#ifdef CB_PARTITIONS
+cbuffer Frame : register(b1)
+{
+	float4 tint;
+};
+
+cbuffer Material : register(b2)
+{
+	float4 material_color;
+};
+#endif
+
 float4 main() : SV_TARGET
 {
-    return color;
+#ifdef CB_PARTITIONS
+	return ObjectColor() * material_color + tint;
+#else
+	return ObjectColor();
+#endif
 }
+#endif
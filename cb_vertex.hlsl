@@ -1,4 +1,47 @@
+#ifdef INSTANCE_VERTEX_BUFFER
+struct VSOutput
+{
+	float4 position : SV_POSITION;
+	nointerpolation float4 color : COLOR;
+};
+
+VSOutput main(float3 pos : POSITION, float4 instance_pos : INSTANCE_POS, float4 instance_color : INSTANCE_COLOR)
+{
+	VSOutput output;
+	output.position = float4(pos, 1.0f);
+	output.color = instance_color;
+	return output;
+}
+#elif defined CB_PAYLOAD_HALF || defined CB_PAYLOAD_QUANTIZED
+cbuffer ConstantBuffer : register(b0)
+{
+	uint2 packed_pos;
+	uint packed_color;
+};
+
+#ifdef CB_PAYLOAD_QUANTIZED
+cbuffer Origin : register(b3)
+{
+	float3 origin;
+	float extent;
+};
+#endif
+
+float4 main(float3 pos : POSITION) : SV_POSITION
+{
+#ifdef CB_PAYLOAD_HALF
+	// f16tof32 only looks at the lower 16 bits.
+	float3 object_pos = f16tof32(uint3(packed_pos.x, packed_pos.x >> 16, packed_pos.y));
+#else
+	// Shifting the signed values back down sign extends the 16 bit snorms.
+	int3 quantized = int3(packed_pos.x << 16, packed_pos.x, packed_pos.y << 16) >> 16;
+	float3 object_pos = origin + quantized * (extent / 32767.0f);
+#endif
+	return float4(pos + object_pos, 1.0f);
+}
+#else
 float4 main(float3 pos : POSITION) : SV_POSITION
 {
     return float4(pos, 1.0f);
 }
+#endif
@@ -0,0 +1,10 @@
+struct VSOutput
+{
+	float4 position : SV_POSITION;
+	nointerpolation float4 color : COLOR;
+};
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	return input.color;
+}
@@ -0,0 +1,27 @@
+struct InstanceData
+{
+	float4 pos;
+	float4 color;
+};
+
+cbuffer Batch : register(b0)
+{
+	uint instance_base;
+};
+
+StructuredBuffer<InstanceData> instances : register(t0);
+
+struct VSOutput
+{
+	float4 position : SV_POSITION;
+	nointerpolation float4 color : COLOR;
+};
+
+// SV_InstanceID doesn't include the start instance, the batch offset comes from a root constant.
+VSOutput main(float3 pos : POSITION, uint instance_id : SV_InstanceID)
+{
+	VSOutput output;
+	output.position = float4(pos, 1.0f);
+	output.color = instances[instance_base + instance_id].color;
+	return output;
+}
@@ -0,0 +1,26 @@
+// The layout is passed in as macros computed from the C++ structs.
+// VERTEX_STRIDE, INSTANCE_STRIDE, INSTANCE_COLOR_OFFSET
+
+cbuffer Batch : register(b0)
+{
+	uint instance_base;
+};
+
+ByteAddressBuffer vertices : register(t0);
+ByteAddressBuffer instances : register(t1);
+
+struct VSOutput
+{
+	float4 position : SV_POSITION;
+	nointerpolation float4 color : COLOR;
+};
+
+VSOutput main(uint vertex_id : SV_VertexID, uint instance_id : SV_InstanceID)
+{
+	uint instance = (instance_base + instance_id) * INSTANCE_STRIDE;
+
+	VSOutput output;
+	output.position = float4(asfloat(vertices.Load3(vertex_id * VERTEX_STRIDE)), 1.0f);
+	output.color = asfloat(instances.Load4(instance + INSTANCE_COLOR_OFFSET));
+	return output;
+}
@@ -0,0 +1,25 @@
+cbuffer Scatter : register(b0)
+{
+	uint record_count;
+	uint record_stride;
+	uint slot_size;
+	uint payload_size;
+};
+
+// Every record is the slot index followed by the payload, all sizes in bytes.
+ByteAddressBuffer records : register(t0);
+RWByteAddressBuffer slots : register(u0);
+
+[numthreads(64, 1, 1)]
+void main(uint3 thread_id : SV_DispatchThreadID)
+{
+	if (thread_id.x >= record_count)
+		return;
+
+	uint record = thread_id.x * record_stride;
+	uint slot = records.Load(record) * slot_size;
+	for (uint i = 0; i < payload_size; i += 4)
+	{
+		slots.Store(slot + i, records.Load(record + 4 + i));
+	}
+}
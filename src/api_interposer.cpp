@@ -0,0 +1,108 @@
+#include "api_interposer.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace interposer {
+
+	static std::mutex registry_mutex;
+	// Never freed, threads that exit keep their results.
+	static std::vector<std::unique_ptr<ThreadStats>> registry;
+
+	static const std::array<char const *, static_cast<std::size_t>(Call::Count)> call_names = {
+		"SetPipelineState",
+		"SetGraphicsRootSignature",
+		"SetGraphicsRootConstantBufferView",
+		"SetGraphicsRootShaderResourceView",
+		"SetGraphicsRoot32BitConstant",
+		"RSSetViewports",
+		"RSSetScissorRects",
+		"IASetPrimitiveTopology",
+		"IASetVertexBuffers",
+		"OMSetRenderTargets",
+		"ClearRenderTargetView",
+		"ClearDepthStencilView",
+		"ResourceBarrier",
+		"DrawInstanced",
+		"ExecuteBundle",
+		"Close",
+		"ExecuteCommandLists",
+		"Map",
+		"Unmap",
+		"GetGPUVirtualAddress",
+		"CreateCommittedResource",
+		"CreateDescriptorHeap",
+		"CreateCommandAllocator",
+		"CreateCommandList",
+	};
+
+	ThreadStats& GetThreadStats()
+	{
+		thread_local ThreadStats* stats = nullptr;
+		if (!stats)
+		{
+			std::lock_guard<std::mutex> lock(registry_mutex);
+			registry.push_back(std::make_unique<ThreadStats>());
+			stats = registry.back().get();
+		}
+		return *stats;
+	}
+
+	void PrintResults(std::string const & path)
+	{
+		// Cost of the instrumentation itself, so it can be told apart from the time spent in the runtime and driver.
+		constexpr int num_samples = 10000;
+		auto calibration_start = Clock::now();
+		for (auto i = 0; i < num_samples; i++)
+		{
+			volatile auto now = Clock::now();
+			(void)now;
+		}
+		long double timer_ns = std::chrono::duration<long double, std::nano>(Clock::now() - calibration_start).count() / num_samples;
+
+		std::ofstream file;
+		file.open(path);
+
+		file << "API calls (timer overhead " << timer_ns << "ns per call):\n";
+
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (std::size_t i = 0; i < call_names.size(); i++)
+		{
+			std::uint64_t count = 0;
+			std::uint64_t ns = 0;
+			std::uint64_t filtered = 0;
+			for (auto const & stats : registry)
+			{
+				count += (*stats)[i].count.load(std::memory_order_relaxed);
+				ns += (*stats)[i].ns.load(std::memory_order_relaxed);
+				filtered += (*stats)[i].filtered.load(std::memory_order_relaxed);
+			}
+
+			if (count == 0 && filtered == 0)
+				continue;
+
+			file << '\t' << call_names[i] << ":\n";
+			// Without API_INTERPOSER only the filtered calls are counted.
+			if (count > 0)
+			{
+				long double average = (long double)ns / count;
+				file << "\t\tCalls: " << count << '\n';
+				file << "\t\tTotal: " << ns / 1000000.0L << "ms\n";
+				file << "\t\tAverage: " << average << "ns (" << (std::max)(average - timer_ns, 0.0L) << "ns without timer overhead)\n";
+			}
+			if (filtered > 0)
+			{
+				file << "\t\tFiltered: " << filtered;
+				if (count > 0)
+					file << " (" << 100.0L * filtered / (count + filtered) << "% of the calls)";
+				file << '\n';
+			}
+		}
+
+		file.close();
+	}
+
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <d3d12.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Count and time every D3D12 call the benchmark makes. Costs two timer reads per call.
+//#define API_INTERPOSER
+
+// Drop calls that would set state that is already bound. The filtered calls are counted.
+//#define STATE_FILTERING
+
+namespace interposer
+{
+
+	enum class Call
+	{
+		SetPipelineState,
+		SetGraphicsRootSignature,
+		SetGraphicsRootConstantBufferView,
+		SetGraphicsRootShaderResourceView,
+		SetGraphicsRoot32BitConstant,
+		RSSetViewports,
+		RSSetScissorRects,
+		IASetPrimitiveTopology,
+		IASetVertexBuffers,
+		OMSetRenderTargets,
+		ClearRenderTargetView,
+		ClearDepthStencilView,
+		ResourceBarrier,
+		DrawInstanced,
+		ExecuteBundle,
+		Close,
+		ExecuteCommandLists,
+		Map,
+		Unmap,
+		GetGPUVirtualAddress,
+		CreateCommittedResource,
+		CreateDescriptorHeap,
+		CreateCommandAllocator,
+		CreateCommandList,
+		Count
+	};
+
+	using Clock = std::chrono::high_resolution_clock;
+
+	// Only the owning thread writes, so relaxed loads and stores are enough and no cache line is shared between threads.
+	struct CallStats
+	{
+		std::atomic<std::uint64_t> count{ 0 };
+		std::atomic<std::uint64_t> ns{ 0 };
+		std::atomic<std::uint64_t> filtered{ 0 };
+	};
+
+	using ThreadStats = std::array<CallStats, static_cast<std::size_t>(Call::Count)>;
+
+	ThreadStats& GetThreadStats();
+
+	inline void Record(Call call, Clock::time_point start)
+	{
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		auto& stats = GetThreadStats()[static_cast<std::size_t>(call)];
+		stats.count.store(stats.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		stats.ns.store(stats.ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	}
+
+	inline void RecordFiltered(Call call)
+	{
+		auto& stats = GetThreadStats()[static_cast<std::size_t>(call)];
+		stats.filtered.store(stats.filtered.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Sums the stats of every thread into a per call cost table.
+	void PrintResults(std::string const & path);
+
+} /* interposer */
+
+#ifdef API_INTERPOSER
+#define INTERPOSE(call, expr) { auto interpose_start = interposer::Clock::now(); expr; interposer::Record(interposer::Call::call, interpose_start); }
+#else
+#define INTERPOSE(call, expr) { expr; }
+#endif
+
+#ifdef STATE_FILTERING
+#define FILTER(call, redundant) if (redundant) { interposer::RecordFiltered(interposer::Call::call); return; }
+#else
+#define FILTER(call, redundant)
+#endif
+
+namespace interposer
+{
+
+	inline HRESULT Map(ID3D12Resource* resource, UINT subresource, D3D12_RANGE const * read_range, void** data)
+	{
+		HRESULT hr;
+		INTERPOSE(Map, hr = resource->Map(subresource, read_range, data));
+		return hr;
+	}
+
+	inline void Unmap(ID3D12Resource* resource, UINT subresource, D3D12_RANGE const * written_range)
+	{
+		INTERPOSE(Unmap, resource->Unmap(subresource, written_range));
+	}
+
+	inline D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress(ID3D12Resource* resource)
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+		INTERPOSE(GetGPUVirtualAddress, address = resource->GetGPUVirtualAddress());
+		return address;
+	}
+
+	inline void ExecuteCommandLists(ID3D12CommandQueue* queue, UINT num_lists, ID3D12CommandList* const * lists)
+	{
+		INTERPOSE(ExecuteCommandLists, queue->ExecuteCommandLists(num_lists, lists));
+	}
+
+	inline HRESULT CreateCommittedResource(ID3D12Device* device, D3D12_HEAP_PROPERTIES const * heap_properties, D3D12_HEAP_FLAGS heap_flags,
+		D3D12_RESOURCE_DESC const * desc, D3D12_RESOURCE_STATES initial_state, D3D12_CLEAR_VALUE const * clear_value, REFIID riid, void** resource)
+	{
+		HRESULT hr;
+		INTERPOSE(CreateCommittedResource, hr = device->CreateCommittedResource(heap_properties, heap_flags, desc, initial_state, clear_value, riid, resource));
+		return hr;
+	}
+
+	inline HRESULT CreateDescriptorHeap(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_DESC const * desc, REFIID riid, void** heap)
+	{
+		HRESULT hr;
+		INTERPOSE(CreateDescriptorHeap, hr = device->CreateDescriptorHeap(desc, riid, heap));
+		return hr;
+	}
+
+	inline HRESULT CreateCommandAllocator(ID3D12Device* device, D3D12_COMMAND_LIST_TYPE type, REFIID riid, void** allocator)
+	{
+		HRESULT hr;
+		INTERPOSE(CreateCommandAllocator, hr = device->CreateCommandAllocator(type, riid, allocator));
+		return hr;
+	}
+
+	inline HRESULT CreateCommandList(ID3D12Device* device, UINT node_mask, D3D12_COMMAND_LIST_TYPE type, ID3D12CommandAllocator* allocator,
+		ID3D12PipelineState* pso, REFIID riid, void** list)
+	{
+		HRESULT hr;
+		INTERPOSE(CreateCommandList, hr = device->CreateCommandList(node_mask, type, allocator, pso, riid, list));
+		return hr;
+	}
+
+} /* interposer */
+
+// Forwards to a command list. Mirrors the methods the benchmark records so it can stand in for the list itself.
+// Keeps track of the bound state so redundant calls can be filtered.
+class CommandRecorder
+{
+public:
+	static constexpr std::size_t max_root_parameters = 8;
+	static constexpr std::size_t max_vertex_buffers = 4;
+
+	CommandRecorder() : list(nullptr) {}
+	explicit CommandRecorder(ID3D12GraphicsCommandList2* list) : list(list) {}
+
+	ID3D12GraphicsCommandList2* Get() const { return list; }
+
+	// Call after the list was reset, resetting binds pso and clears everything else.
+	void Reset(ID3D12PipelineState* pso)
+	{
+		state = State();
+		state.pso = pso;
+	}
+
+	void SetPipelineState(ID3D12PipelineState* pso)
+	{
+		FILTER(SetPipelineState, pso == state.pso);
+		state.pso = pso;
+		INTERPOSE(SetPipelineState, list->SetPipelineState(pso));
+	}
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* root_signature)
+	{
+		FILTER(SetGraphicsRootSignature, root_signature == state.root_signature);
+		// Changing the root signature invalidates all root arguments.
+		state.root_signature = root_signature;
+		state.root_descriptors.fill(0);
+		state.root_constants.fill(0);
+		INTERPOSE(SetGraphicsRootSignature, list->SetGraphicsRootSignature(root_signature));
+	}
+
+	void SetGraphicsRootConstantBufferView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (idx < max_root_parameters)
+		{
+			FILTER(SetGraphicsRootConstantBufferView, address == state.root_descriptors[idx]);
+			state.root_descriptors[idx] = address;
+		}
+		INTERPOSE(SetGraphicsRootConstantBufferView, list->SetGraphicsRootConstantBufferView(idx, address));
+	}
+
+	void SetGraphicsRootShaderResourceView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (idx < max_root_parameters)
+		{
+			FILTER(SetGraphicsRootShaderResourceView, address == state.root_descriptors[idx]);
+			state.root_descriptors[idx] = address;
+		}
+		INTERPOSE(SetGraphicsRootShaderResourceView, list->SetGraphicsRootShaderResourceView(idx, address));
+	}
+
+	// Only the first constant of a parameter is tracked.
+	void SetGraphicsRoot32BitConstant(UINT idx, UINT value, UINT offset)
+	{
+		if (idx < max_root_parameters && offset == 0)
+		{
+			std::uint64_t tagged = value | constant_set_bit;
+			FILTER(SetGraphicsRoot32BitConstant, tagged == state.root_constants[idx]);
+			state.root_constants[idx] = tagged;
+		}
+		INTERPOSE(SetGraphicsRoot32BitConstant, list->SetGraphicsRoot32BitConstant(idx, value, offset));
+	}
+
+	void RSSetViewports(UINT num, D3D12_VIEWPORT const * viewports)
+	{
+		FILTER(RSSetViewports, num == 1 && state.viewport_set && std::memcmp(viewports, &state.viewport, sizeof(D3D12_VIEWPORT)) == 0);
+		state.viewport_set = num == 1;
+		if (num == 1)
+			state.viewport = viewports[0];
+		INTERPOSE(RSSetViewports, list->RSSetViewports(num, viewports));
+	}
+
+	void RSSetScissorRects(UINT num, D3D12_RECT const * rects)
+	{
+		FILTER(RSSetScissorRects, num == 1 && state.scissor_set && std::memcmp(rects, &state.scissor, sizeof(D3D12_RECT)) == 0);
+		state.scissor_set = num == 1;
+		if (num == 1)
+			state.scissor = rects[0];
+		INTERPOSE(RSSetScissorRects, list->RSSetScissorRects(num, rects));
+	}
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+	{
+		FILTER(IASetPrimitiveTopology, topology == state.topology);
+		state.topology = topology;
+		INTERPOSE(IASetPrimitiveTopology, list->IASetPrimitiveTopology(topology));
+	}
+
+	void IASetVertexBuffers(UINT start_slot, UINT num, D3D12_VERTEX_BUFFER_VIEW const * views)
+	{
+		// Only views that fit in the cached slots can be compared.
+		FILTER(IASetVertexBuffers, views && start_slot + num <= max_vertex_buffers && std::memcmp(views, &state.vertex_buffers[start_slot], num * sizeof(D3D12_VERTEX_BUFFER_VIEW)) == 0);
+		for (UINT i = 0; i < num && start_slot + i < max_vertex_buffers; i++)
+			state.vertex_buffers[start_slot + i] = views ? views[i] : D3D12_VERTEX_BUFFER_VIEW{};
+		INTERPOSE(IASetVertexBuffers, list->IASetVertexBuffers(start_slot, num, views));
+	}
+
+	void OMSetRenderTargets(UINT num, D3D12_CPU_DESCRIPTOR_HANDLE const * rtvs, BOOL single_handle, D3D12_CPU_DESCRIPTOR_HANDLE const * dsv)
+	{
+		INTERPOSE(OMSetRenderTargets, list->OMSetRenderTargets(num, rtvs, single_handle, dsv));
+	}
+
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE rtv, FLOAT const color[4], UINT num_rects, D3D12_RECT const * rects)
+	{
+		INTERPOSE(ClearRenderTargetView, list->ClearRenderTargetView(rtv, color, num_rects, rects));
+	}
+
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE dsv, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil, UINT num_rects, D3D12_RECT const * rects)
+	{
+		INTERPOSE(ClearDepthStencilView, list->ClearDepthStencilView(dsv, flags, depth, stencil, num_rects, rects));
+	}
+
+	void ResourceBarrier(UINT num, D3D12_RESOURCE_BARRIER const * barriers)
+	{
+		INTERPOSE(ResourceBarrier, list->ResourceBarrier(num, barriers));
+	}
+
+	void DrawInstanced(UINT vertex_count, UINT instance_count, UINT start_vertex, UINT start_instance)
+	{
+		INTERPOSE(DrawInstanced, list->DrawInstanced(vertex_count, instance_count, start_vertex, start_instance));
+	}
+
+	void ExecuteBundle(ID3D12GraphicsCommandList* bundle)
+	{
+		INTERPOSE(ExecuteBundle, list->ExecuteBundle(bundle));
+
+		// State set by the bundle is inherited back, except for the viewports, scissors and the root signature which it has to share.
+		auto root_signature = state.root_signature;
+		auto viewport = state.viewport;
+		auto scissor = state.scissor;
+		auto viewport_set = state.viewport_set;
+		auto scissor_set = state.scissor_set;
+		state = State();
+		state.root_signature = root_signature;
+		state.viewport = viewport;
+		state.scissor = scissor;
+		state.viewport_set = viewport_set;
+		state.scissor_set = scissor_set;
+	}
+
+	HRESULT Close()
+	{
+		HRESULT hr;
+		INTERPOSE(Close, hr = list->Close());
+		return hr;
+	}
+
+private:
+	static constexpr std::uint64_t constant_set_bit = 1ull << 32;
+
+	// Zeroed state is unknown, which matches what a freshly reset list has bound.
+	struct State
+	{
+		ID3D12PipelineState* pso = nullptr;
+		ID3D12RootSignature* root_signature = nullptr;
+		std::array<D3D12_GPU_VIRTUAL_ADDRESS, max_root_parameters> root_descriptors = {};
+		std::array<std::uint64_t, max_root_parameters> root_constants = {};
+		D3D12_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		std::array<D3D12_VERTEX_BUFFER_VIEW, max_vertex_buffers> vertex_buffers = {};
+		D3D12_VIEWPORT viewport = {};
+		D3D12_RECT scissor = {};
+		bool viewport_set = false;
+		bool scissor_set = false;
+	};
+
+	ID3D12GraphicsCommandList2* list;
+	State state;
+};
@@ -0,0 +1,123 @@
+#include "command_pool.hpp"
+
+#include "memory_accounting.hpp"
+
+CommandListPool::CommandListPool(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, std::size_t large_threshold, std::wstring name)
+	: device(device),
+	type(type),
+	large_threshold(large_threshold),
+	name(name)
+{
+}
+
+PooledCommandList* CommandListPool::Acquire(ID3D12PipelineState* pso, bool expect_large)
+{
+	PooledCommandList* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Recycle();
+
+		// Use an allocator of the right size class if possible so small lists don't pin a lot of memory.
+		auto& preferred = expect_large ? free_large : free_small;
+		auto& fallback = expect_large ? free_small : free_large;
+		if (!preferred.empty())
+		{
+			entry = preferred.back();
+			preferred.pop_back();
+		}
+		else if (!fallback.empty())
+		{
+			entry = fallback.back();
+			fallback.pop_back();
+		}
+		else
+		{
+			entry = Create();
+		}
+	}
+
+	HRESULT hr = entry->allocator->Reset();
+	if (FAILED(hr))
+	{
+		throw "Failed to reset pooled command allocator";
+	}
+
+	hr = entry->list->Reset(entry->allocator.Get(), pso);
+	if (FAILED(hr))
+	{
+		throw "Failed to reset pooled command list";
+	}
+
+	entry->recorder.Reset(pso);
+	entry->num_commands = 0;
+	return entry;
+}
+
+void CommandListPool::Release(PooledCommandList* entry, ID3D12Fence* fence, UINT64 fence_value)
+{
+	// Allocators never shrink, once big it stays big.
+	entry->large = entry->large || entry->num_commands >= large_threshold;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	in_flight.push_back({ entry, fence, fence_value });
+}
+
+std::size_t CommandListPool::GetNumCreated() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+void CommandListPool::Recycle()
+{
+	// Cache the completed value per fence, GetCompletedValue isn't free.
+	ID3D12Fence* cached_fence = nullptr;
+	UINT64 cached_value = 0;
+
+	for (auto it = in_flight.begin(); it != in_flight.end();)
+	{
+		if (it->fence != cached_fence)
+		{
+			cached_fence = it->fence;
+			cached_value = it->fence->GetCompletedValue();
+		}
+
+		if (cached_value >= it->fence_value)
+		{
+			(it->entry->large ? free_large : free_small).push_back(it->entry);
+			it = in_flight.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+PooledCommandList* CommandListPool::Create()
+{
+	entries.emplace_back();
+	auto& entry = entries.back();
+
+	HRESULT hr = interposer::CreateCommandAllocator(device.Get(), type, IID_PPV_ARGS(&entry.allocator));
+	if (FAILED(hr))
+	{
+		throw "Failed to create command allocator";
+	}
+	entry.allocator->SetName((name + L" Allocator").c_str());
+	// The driver doesn't expose how big an allocator grew, only the amount is tracked.
+	memory::Allocate(memory::Category::CommandAllocators, 0, 0);
+
+	hr = interposer::CreateCommandList(device.Get(), 0, type, entry.allocator.Get(), nullptr, IID_PPV_ARGS(&entry.list));
+	if (FAILED(hr))
+	{
+		throw "Failed to create command list";
+	}
+	entry.list->SetName(name.c_str());
+	entry.recorder = CommandRecorder(entry.list.Get());
+
+	// Command lists are created in the recording state, Acquire resets it.
+	entry.list->Close();
+
+	return &entry;
+}
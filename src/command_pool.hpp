@@ -0,0 +1,60 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+#include "api_interposer.hpp"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct PooledCommandList
+{
+	ComPtr<ID3D12CommandAllocator> allocator;
+	ComPtr<ID3D12GraphicsCommandList2> list;
+	// Record through this so the calls can be instrumented.
+	CommandRecorder recorder;
+
+	// Amount of commands recorded since the last acquire, filled in by the user. Used to keep big allocators apart.
+	std::size_t num_commands = 0;
+	bool large = false;
+};
+
+// Hands out allocator + command list pairs of a single queue type. Pairs are recycled once the GPU is done with them.
+// Acquire and Release are thread safe so every recording thread can get its own pair.
+class CommandListPool
+{
+public:
+	CommandListPool(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, std::size_t large_threshold, std::wstring name = L"Pooled Command List");
+
+	CommandListPool(CommandListPool const &) = delete;
+	CommandListPool& operator=(CommandListPool const &) = delete;
+
+	// Returns a reset pair in the recording state. Prefers allocators that grew big before when expect_large is set.
+	[[nodiscard]] PooledCommandList* Acquire(ID3D12PipelineState* pso = nullptr, bool expect_large = false);
+	// Returns a submitted pair. It won't be handed out again before fence reaches fence_value.
+	void Release(PooledCommandList* entry, ID3D12Fence* fence, UINT64 fence_value);
+
+	std::size_t GetNumCreated() const;
+
+private:
+	struct InFlight
+	{
+		PooledCommandList* entry;
+		ID3D12Fence* fence;
+		UINT64 fence_value;
+	};
+
+	void Recycle();
+	PooledCommandList* Create();
+
+	ComPtr<ID3D12Device> device;
+	D3D12_COMMAND_LIST_TYPE type;
+	std::size_t large_threshold;
+	std::wstring name;
+
+	mutable std::mutex mutex;
+	std::deque<PooledCommandList> entries; // Deque so handed out pointers stay valid.
+	std::vector<PooledCommandList*> free_small;
+	std::vector<PooledCommandList*> free_large;
+	std::deque<InFlight> in_flight;
+};
@@ -0,0 +1,423 @@
+#include "constant_uploader.hpp"
+
+#include "memory_accounting.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+// Has to match numthreads in scatter_compute.hlsl.
+static constexpr std::uint32_t scatter_group_size = 64;
+
+// Root parameters of the scatter: 0 these constants, 1 records, 2 slots
+enum ScatterConstant
+{
+	RecordCount,
+	RecordStride,
+	SlotSize,
+	PayloadSize,
+	NumScatterConstants
+};
+
+ConstantUploader::ConstantUploader(ComPtr<ID3D12Device> device, std::uint32_t num_copies, std::uint32_t num_slots, std::uint32_t slot_size, std::uint32_t payload_size,
+	std::uint64_t ring_size, std::uint32_t spin_threshold_us, D3D12_SHADER_BYTECODE scatter_shader)
+	: device(device),
+	num_copies(num_copies),
+	num_slots(num_slots),
+	slot_size(slot_size),
+	payload_size(payload_size),
+	record_stride(GetRecordStride(payload_size)),
+	scatter(scatter_shader.pShaderBytecode != nullptr),
+	upload_fence(device, spin_threshold_us, L"Upload Queue Fence"),
+	ring_size(ring_size),
+	shadow((std::size_t)num_slots * slot_size, 0),
+	// The buffers start out undefined, so the first flush of every copy uploads everything.
+	dirty(num_slots, static_cast<std::uint8_t>((1u << num_copies) - 1))
+{
+	if (((payload_size + 3) & ~3u) > slot_size || ring_size < (scatter ? record_stride : slot_size))
+	{
+		throw "The payload has to fit into a slot and the upload ring has to fit at least one of them";
+	}
+	if (num_copies == 0 || num_copies > max_copies)
+	{
+		throw "The number of buffer copies has to fit into the dirty bits";
+	}
+
+	// Copy queues can't dispatch, the scatter runs on a compute queue.
+	auto type = scatter ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_COPY;
+	D3D12_COMMAND_QUEUE_DESC queue_desc = { type, 0, D3D12_COMMAND_QUEUE_FLAG_NONE };
+	HRESULT hr = device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&upload_queue));
+	if (FAILED(hr))
+	{
+		throw "Failed to create upload command queue";
+	}
+	upload_queue->SetName(L"Constant Upload Queue");
+
+	// Upload lists are tiny, there is no point in keeping big allocators apart.
+	upload_pool = std::make_unique<CommandListPool>(device, type, (std::numeric_limits<std::size_t>::max)(), L"Constant Upload Command List");
+
+	if (scatter)
+	{
+		CreateScatterPipeline(scatter_shader);
+	}
+
+	// Buffers are promoted from COMMON implicitly, to the copy or UAV state on the upload queue and to a read state
+	// on the direct queue, and decay back at the end of every ExecuteCommandLists. No barriers needed on either queue.
+	std::uint64_t buffer_size = (std::uint64_t)num_slots * slot_size;
+	auto flags = scatter ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
+	buffers.resize(num_copies);
+	gpu_addresses.resize(num_copies);
+	for (std::uint32_t i = 0; i < num_copies; i++)
+	{
+		hr = interposer::CreateCommittedResource(
+			device.Get(),
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(buffer_size, flags),
+			D3D12_RESOURCE_STATE_COMMON,
+			nullptr,
+			IID_PPV_ARGS(&buffers[i]));
+		if (FAILED(hr))
+		{
+			throw "Failed to create default heap constant buffer";
+		}
+		buffers[i]->SetName(L"Constant Buffer Default Heap");
+		memory::Allocate(memory::Category::ConstantData, buffer_size, memory::GetAllocatedSize(device.Get(), buffers[i].Get()));
+		gpu_addresses[i] = buffers[i]->GetGPUVirtualAddress();
+	}
+
+	hr = interposer::CreateCommittedResource(
+		device.Get(),
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(ring_size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&ring));
+	if (FAILED(hr))
+	{
+		throw "Failed to create upload ring";
+	}
+	ring->SetName(L"Constant Upload Ring");
+	memory::Allocate(memory::Category::Staging, ring_size, memory::GetAllocatedSize(device.Get(), ring.Get()));
+	ring_gpu_address = ring->GetGPUVirtualAddress();
+
+	CD3DX12_RANGE read_range(0, 0);
+	hr = ring->Map(0, &read_range, reinterpret_cast<void**>(&ring_address));
+	if (FAILED(hr))
+	{
+		throw "Failed to map upload ring";
+	}
+}
+
+ConstantUploader::~ConstantUploader()
+{
+	upload_fence.Flush("shutdown");
+
+	for (auto& buffer : buffers)
+		memory::Free(memory::Category::ConstantData, (std::uint64_t)num_slots * slot_size, memory::GetAllocatedSize(device.Get(), buffer.Get()));
+	memory::Free(memory::Category::Staging, ring_size, memory::GetAllocatedSize(device.Get(), ring.Get()));
+	if (readback)
+	{
+		memory::Free(memory::Category::Staging, (std::uint64_t)num_copies * num_slots * slot_size, memory::GetAllocatedSize(device.Get(), readback.Get()));
+	}
+}
+
+void ConstantUploader::Write(std::uint32_t slot, void const * payload)
+{
+	auto dst = shadow.data() + (std::size_t)slot * slot_size;
+	if (std::memcmp(dst, payload, payload_size) == 0)
+		return;
+
+	std::memcpy(dst, payload, payload_size);
+	dirty[slot] = static_cast<std::uint8_t>((1u << num_copies) - 1);
+}
+
+void ConstantUploader::Flush(std::uint32_t copy, ID3D12CommandQueue* queue, ID3D12Fence* read_fence, UINT64 read_value)
+{
+	last_stats = UploadStats();
+
+	// Give back the space of finished uploads without waiting.
+	while (!in_flight.empty() && upload_fence.IsCompleted(in_flight.front().fence_value))
+	{
+		ring_tail = in_flight.front().ring_end;
+		in_flight.pop_front();
+	}
+
+	std::uint8_t bit = 1u << copy;
+	auto num_dirty = static_cast<std::uint32_t>(std::count_if(dirty.begin(), dirty.end(), [bit](std::uint8_t d) { return (d & bit) != 0; }));
+	if (num_dirty == 0)
+		return;
+
+	// Frames that read the other copies keep running while this one is written.
+	upload_queue->Wait(read_fence, read_value);
+
+	if (scatter)
+		StageRecords(copy, num_dirty);
+	else
+		StageCopies(copy);
+
+	Submit();
+	queue->Wait(upload_fence.Get(), upload_fence.GetLastSignaledValue());
+}
+
+void ConstantUploader::EnableVerification()
+{
+	reference.assign(shadow.size() * num_copies, 0);
+}
+
+std::uint32_t ConstantUploader::Verify()
+{
+	std::uint64_t buffer_size = (std::uint64_t)num_slots * slot_size;
+	if (!readback)
+	{
+		HRESULT hr = interposer::CreateCommittedResource(
+			device.Get(),
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(buffer_size * num_copies),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&readback));
+		if (FAILED(hr))
+		{
+			throw "Failed to create readback buffer";
+		}
+		readback->SetName(L"Constant Buffer Readback");
+		memory::Allocate(memory::Category::Staging, buffer_size * num_copies, memory::GetAllocatedSize(device.Get(), readback.Get()));
+	}
+
+	for (std::uint32_t copy = 0; copy < num_copies; copy++)
+		GetOpenList(copy)->list->CopyBufferRegion(readback.Get(), copy * buffer_size, buffers[copy].Get(), 0, buffer_size);
+	Submit();
+	upload_fence.Flush("verify");
+
+	std::uint8_t* data;
+	CD3DX12_RANGE read_range(0, buffer_size * num_copies);
+	HRESULT hr = readback->Map(0, &read_range, reinterpret_cast<void**>(&data));
+	if (FAILED(hr))
+	{
+		throw "Failed to map readback buffer";
+	}
+
+	// Copies and scatters without verification are checked against the written payloads.
+	// Slots that are still dirty in a copy haven't been uploaded to it yet.
+	bool use_reference = scatter && !reference.empty();
+	std::uint32_t mismatches = 0;
+	for (std::uint32_t copy = 0; copy < num_copies; copy++)
+	{
+		auto copy_data = data + copy * buffer_size;
+		auto expected = use_reference ? reference.data() + copy * buffer_size : shadow.data();
+		for (std::uint32_t slot = 0; slot < num_slots; slot++)
+		{
+			std::size_t offset = (std::size_t)slot * slot_size;
+			if (!(dirty[slot] & (1u << copy)) && std::memcmp(copy_data + offset, expected + offset, payload_size) != 0)
+				mismatches++;
+		}
+	}
+
+	CD3DX12_RANGE written_range(0, 0);
+	readback->Unmap(0, &written_range);
+	return mismatches;
+}
+
+ID3D12Resource* ConstantUploader::GetBuffer(std::uint32_t copy) const
+{
+	return buffers[copy].Get();
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS ConstantUploader::GetSlotAddress(std::uint32_t copy, std::uint32_t slot) const
+{
+	return gpu_addresses[copy] + (std::uint64_t)slot * slot_size;
+}
+
+UploadStats const & ConstantUploader::GetLastFlushStats() const
+{
+	return last_stats;
+}
+
+TimelineFence const & ConstantUploader::GetFence() const
+{
+	return upload_fence;
+}
+
+void ConstantUploader::CreateScatterPipeline(D3D12_SHADER_BYTECODE shader)
+{
+	std::array<CD3DX12_ROOT_PARAMETER1, 3> parameters;
+	parameters[0].InitAsConstants(NumScatterConstants, 0);
+	parameters[1].InitAsShaderResourceView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+	parameters[2].InitAsUnorderedAccessView(0);
+
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
+	root_signature_desc.Init_1_1(parameters.size(), parameters.data(), 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	ID3DBlob* signature;
+	ID3DBlob* error = nullptr;
+	HRESULT hr = D3D12SerializeVersionedRootSignature(&root_signature_desc, &signature, &error);
+	if (FAILED(hr))
+	{
+		throw "Failed to create a serialized root signature";
+	}
+
+	hr = device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&scatter_root_signature));
+	if (FAILED(hr))
+	{
+		throw "Failed to create root signature";
+	}
+	scatter_root_signature->SetName(L"Scatter Root Signature");
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc = {};
+	pso_desc.pRootSignature = scatter_root_signature.Get();
+	pso_desc.CS = shader;
+	hr = device->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&scatter_pipeline));
+	if (FAILED(hr))
+	{
+		throw "Failed to create scatter pipeline";
+	}
+	scatter_pipeline->SetName(L"Scatter pipeline object");
+}
+
+std::uint64_t ConstantUploader::AllocateRing(std::uint64_t size)
+{
+	while (true)
+	{
+		// Allocations never wrap around the end of the ring.
+		std::uint64_t position = ring_head % ring_size;
+		std::uint64_t padding = position + size > ring_size ? ring_size - position : 0;
+		if (ring_head + padding + size - ring_tail <= ring_size)
+		{
+			ring_head += padding;
+			break;
+		}
+
+		if (!in_flight.empty())
+		{
+			upload_fence.Wait(in_flight.front().fence_value, "upload_ring");
+			ring_tail = in_flight.front().ring_end;
+			in_flight.pop_front();
+		}
+		else if (open_list)
+		{
+			// The space is taken by uploads of this flush that haven't been submitted yet.
+			Submit();
+		}
+		else
+		{
+			// Nothing uses the ring, start over at its beginning instead of padding.
+			ring_head = ring_tail = 0;
+		}
+	}
+
+	std::uint64_t offset = ring_head % ring_size;
+	ring_head += size;
+	return offset;
+}
+
+PooledCommandList* ConstantUploader::GetOpenList(std::uint32_t copy)
+{
+	if (!open_list)
+	{
+		open_list = upload_pool->Acquire(scatter_pipeline.Get());
+		if (scatter)
+		{
+			// Every flush submits its list before the next one, so a list never scatters into two copies.
+			open_list->list->SetComputeRootSignature(scatter_root_signature.Get());
+			open_list->list->SetComputeRootUnorderedAccessView(2, gpu_addresses[copy]);
+		}
+	}
+
+	return open_list;
+}
+
+void ConstantUploader::StageCopies(std::uint32_t copy)
+{
+	std::uint32_t max_slots = static_cast<std::uint32_t>(ring_size / slot_size);
+	std::uint8_t bit = 1u << copy;
+
+	std::uint32_t slot = 0;
+	while (slot < num_slots)
+	{
+		if (!(dirty[slot] & bit))
+		{
+			slot++;
+			continue;
+		}
+
+		// Adjacent dirty slots are contiguous in both buffers and become one copy.
+		std::uint32_t first = slot;
+		while (slot < num_slots && (dirty[slot] & bit))
+			dirty[slot++] &= ~bit;
+
+		// Runs that don't fit into the ring are split.
+		for (std::uint32_t begin = first; begin < slot; begin += max_slots)
+		{
+			std::uint64_t size = (std::uint64_t)(std::min)(max_slots, slot - begin) * slot_size;
+			std::uint64_t offset = AllocateRing(size);
+			std::memcpy(ring_address + offset, shadow.data() + (std::size_t)begin * slot_size, size);
+
+			auto entry = GetOpenList(copy);
+			entry->list->CopyBufferRegion(buffers[copy].Get(), (std::uint64_t)begin * slot_size, ring.Get(), offset, size);
+			entry->num_commands++;
+
+			last_stats.slots += size / slot_size;
+			last_stats.commands++;
+			last_stats.bytes += size;
+		}
+	}
+}
+
+void ConstantUploader::StageRecords(std::uint32_t copy, std::uint32_t num_dirty)
+{
+	std::uint32_t max_records = static_cast<std::uint32_t>(ring_size / record_stride);
+	std::uint8_t bit = 1u << copy;
+
+	std::uint32_t slot = 0;
+	while (num_dirty > 0)
+	{
+		// Every dispatch scatters one contiguous block of records.
+		std::uint32_t count = (std::min)(num_dirty, max_records);
+		std::uint64_t offset = AllocateRing((std::uint64_t)count * record_stride);
+
+		auto records = ring_address + offset;
+		WriteRecords(shadow.data(), dirty.data(), bit, num_slots, slot_size, payload_size, slot, count, records);
+
+		if (!reference.empty())
+		{
+			// Reads the records back from the ring, which is write combined, but only when verifying.
+			ScatterRecords(records, count, record_stride, payload_size, reference.data() + (std::size_t)copy * num_slots * slot_size, slot_size);
+		}
+
+		std::array<std::uint32_t, NumScatterConstants> constants;
+		constants[RecordCount] = count;
+		constants[RecordStride] = record_stride;
+		constants[SlotSize] = slot_size;
+		constants[PayloadSize] = payload_size;
+
+		auto entry = GetOpenList(copy);
+		entry->list->SetComputeRoot32BitConstants(0, NumScatterConstants, constants.data(), 0);
+		entry->list->SetComputeRootShaderResourceView(1, ring_gpu_address + offset);
+		entry->list->Dispatch((count + scatter_group_size - 1) / scatter_group_size, 1, 1);
+		entry->num_commands++;
+
+		last_stats.slots += count;
+		last_stats.commands++;
+		last_stats.bytes += (std::uint64_t)count * record_stride;
+		num_dirty -= count;
+	}
+}
+
+void ConstantUploader::Submit()
+{
+	if (!open_list)
+		return;
+
+	open_list->recorder.Close();
+	std::array<ID3D12CommandList*, 1> cmd_lists = { open_list->list.Get() };
+	interposer::ExecuteCommandLists(upload_queue.Get(), cmd_lists.size(), cmd_lists.data());
+
+	auto fence_value = upload_fence.Signal(upload_queue.Get());
+	upload_pool->Release(open_list, upload_fence.Get(), fence_value);
+	in_flight.push_back({ ring_head, fence_value });
+	open_list = nullptr;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+#include "command_pool.hpp"
+#include "scatter_records.hpp"
+#include "timeline_fence.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct UploadStats
+{
+	std::uint64_t slots = 0; // Dirty slots that were uploaded
+	std::uint64_t commands = 0; // CopyBufferRegion or Dispatch calls
+	std::uint64_t bytes = 0; // Bytes staged in the upload ring
+};
+
+// Keeps fixed size slots of constant data in default heap buffers so the draws read them from local memory.
+// There is one copy of the buffer per frame in flight, so uploading into one only waits for the frame that last read it.
+// Slots that changed are staged in a small upload ring. By default adjacent dirty slots are copied as one region by a
+// dedicated copy queue. With a scatter shader only their payloads are staged as compact (slot index, payload) records,
+// which a compute queue scatters into the buffer, so the upload scales with the changed bytes instead of the slot size.
+class ConstantUploader
+{
+public:
+	// At most max_copies copies, every one of them holds all slots.
+	static constexpr std::uint32_t max_copies = 8;
+
+	ConstantUploader(ComPtr<ID3D12Device> device, std::uint32_t num_copies, std::uint32_t num_slots, std::uint32_t slot_size, std::uint32_t payload_size,
+		std::uint64_t ring_size, std::uint32_t spin_threshold_us, D3D12_SHADER_BYTECODE scatter_shader = {});
+	~ConstantUploader();
+
+	ConstantUploader(ConstantUploader const &) = delete;
+	ConstantUploader& operator=(ConstantUploader const &) = delete;
+
+	// Keeps a copy of the payload and marks the slot dirty in every copy if it differs from the last write.
+	// Different slots can be written from different threads, but not while Flush runs.
+	void Write(std::uint32_t slot, void const * payload);
+
+	// Uploads the slots that are dirty in this copy. The upload waits until read_fence reaches read_value,
+	// which has to cover the last submitted frame that read this copy. Work submitted to queue after this call waits for the upload.
+	void Flush(std::uint32_t copy, ID3D12CommandQueue* queue, ID3D12Fence* read_fence, UINT64 read_value);
+
+	// Scatters every record on the CPU as well, Verify compares against that instead of the written payloads. Call before the first Flush.
+	void EnableVerification();
+	// Reads every copy back and returns the number of uploaded slots whose payload differs from what it should be. Waits for the GPU.
+	std::uint32_t Verify();
+
+	ID3D12Resource* GetBuffer(std::uint32_t copy) const;
+	D3D12_GPU_VIRTUAL_ADDRESS GetSlotAddress(std::uint32_t copy, std::uint32_t slot) const;
+	UploadStats const & GetLastFlushStats() const;
+	// Every CPU wait for space in the ring is recorded as a stall of this fence.
+	TimelineFence const & GetFence() const;
+
+private:
+	struct InFlight
+	{
+		std::uint64_t ring_end;
+		UINT64 fence_value;
+	};
+
+	void CreateScatterPipeline(D3D12_SHADER_BYTECODE shader);
+	// Returns the ring offset for size contiguous bytes. Waits for older uploads if the ring is full.
+	std::uint64_t AllocateRing(std::uint64_t size);
+	// Scatters into the given copy.
+	PooledCommandList* GetOpenList(std::uint32_t copy);
+	void StageCopies(std::uint32_t copy);
+	void StageRecords(std::uint32_t copy, std::uint32_t num_dirty);
+	void Submit();
+
+	ComPtr<ID3D12Device> device;
+	std::uint32_t num_copies;
+	std::uint32_t num_slots;
+	std::uint32_t slot_size;
+	std::uint32_t payload_size;
+	// Slot index followed by the payload, 4 byte aligned for the byte address loads.
+	std::uint32_t record_stride;
+	bool scatter;
+
+	ComPtr<ID3D12CommandQueue> upload_queue;
+	std::unique_ptr<CommandListPool> upload_pool;
+	TimelineFence upload_fence;
+	PooledCommandList* open_list = nullptr;
+
+	ComPtr<ID3D12RootSignature> scatter_root_signature;
+	ComPtr<ID3D12PipelineState> scatter_pipeline;
+
+	std::vector<ComPtr<ID3D12Resource>> buffers;
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> gpu_addresses;
+	ComPtr<ID3D12Resource> readback;
+
+	ComPtr<ID3D12Resource> ring;
+	std::uint8_t* ring_address;
+	D3D12_GPU_VIRTUAL_ADDRESS ring_gpu_address;
+	std::uint64_t ring_size;
+	// Total bytes ever allocated and released, the offset into the ring is modulo its size.
+	std::uint64_t ring_head = 0;
+	std::uint64_t ring_tail = 0;
+	std::deque<InFlight> in_flight;
+
+	// CPU copy of every slot, the source of the staging.
+	std::vector<std::uint8_t> shadow;
+	// One byte per slot so different threads never write the same memory location, bit i is set while copy i is out of date.
+	std::vector<std::uint8_t> dirty;
+	// What every copy should hold according to the CPU scatter, one after the other. Only filled with verification enabled.
+	std::vector<std::uint8_t> reference;
+
+	UploadStats last_stats;
+};
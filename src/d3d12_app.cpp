@@ -1,6 +1,7 @@
 #include "d3d12_app.hpp"
 
 #include <assert.h>
+#include "api_interposer.hpp"
 #include "profiler.hpp"
 
 std::uint32_t D3D12App::rtv_increment_size = 0;
@@ -269,7 +270,7 @@ ComPtr<ID3D12DescriptorHeap> CreateDepthStencilHeap(ComPtr<ID3D12Device> device,
 	heap_desc.NumDescriptors = num_buffers;
 	heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
 	heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	HRESULT hr = device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&heap));
+	HRESULT hr = interposer::CreateDescriptorHeap(device.Get(), &heap_desc, IID_PPV_ARGS(&heap));
 
 	if (FAILED(hr))
 	{
@@ -293,7 +294,8 @@ ComPtr<ID3D12Resource> CreateDepthStencilBuffer(ComPtr<ID3D12Device> device, CD3
 	optimized_clear_value.DepthStencil.Depth = 1.0f;
 	optimized_clear_value.DepthStencil.Stencil = 0;
 
-	HRESULT hr = device->CreateCommittedResource(
+	HRESULT hr = interposer::CreateCommittedResource(
+		device.Get(),
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 		D3D12_HEAP_FLAG_NONE,
 		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, width, height, 1, 0, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL),
@@ -325,7 +327,7 @@ ComPtr<ID3D12DescriptorHeap> CreateRenderTargetViewHeap(ComPtr<ID3D12Device> dev
 	heap_desc.NumDescriptors = num_buffers;
 	heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	HRESULT hr = device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&heap));
+	HRESULT hr = interposer::CreateDescriptorHeap(device.Get(), &heap_desc, IID_PPV_ARGS(&heap));
 
 	if (FAILED(hr))
 	{
@@ -363,12 +365,12 @@ std::wstring GetUTF16(std::string_view const str, int codepage)
 	return retval;
 }
 
-std::pair<ID3DBlob*, D3D12_SHADER_BYTECODE> LoadShader(std::string_view path, std::string_view entry, std::string_view type)
+std::pair<ID3DBlob*, D3D12_SHADER_BYTECODE> LoadShader(std::string_view path, std::string_view entry, std::string_view type, D3D_SHADER_MACRO const * defines)
 {
 	ID3DBlob* shader;
 	ID3DBlob* error;
 	HRESULT hr = D3DCompileFromFile(GetUTF16(path, CP_UTF8).c_str(),
-		nullptr,
+		defines,
 		nullptr,
 		entry.data(),
 		type.data(),
@@ -135,7 +135,7 @@ template<std::uint8_t NUM = D3D12App::num_backbuffers>
 }
 
 template<std::uint8_t NUM = D3D12App::num_backbuffers>
-void ResetVersionedCommandListAndAllocator(ComPtr<ID3D12GraphicsCommandList2> cmd_list, std::array<ComPtr<ID3D12CommandAllocator>, NUM> cmd_allocators, std::uint8_t frame_idx, ComPtr<ID3D12PipelineState> pso = nullptr)
+void ResetVersionedCommandListAndAllocator(ComPtr<ID3D12GraphicsCommandList2> const & cmd_list, std::array<ComPtr<ID3D12CommandAllocator>, NUM> const & cmd_allocators, std::uint8_t frame_idx, ID3D12PipelineState* pso = nullptr)
 {
 	// Reset command allocators and buffers
 	HRESULT hr = cmd_allocators[frame_idx]->Reset();
@@ -144,7 +144,7 @@ void ResetVersionedCommandListAndAllocator(ComPtr<ID3D12GraphicsCommandList2> cm
 		throw "Failed to reset cmd allocators";
 	}
 
-	hr = cmd_list->Reset(cmd_allocators[frame_idx].Get(), pso.Get());
+	hr = cmd_list->Reset(cmd_allocators[frame_idx].Get(), pso);
 	if (FAILED(hr))
 	{
 		throw "Failed to reset command list";
@@ -152,4 +152,5 @@ void ResetVersionedCommandListAndAllocator(ComPtr<ID3D12GraphicsCommandList2> cm
 }
 
 [[nodiscard]] std::wstring GetUTF16(std::string_view const str, int codepage);
-[[nodiscard]] std::pair<ID3DBlob*, D3D12_SHADER_BYTECODE> LoadShader(std::string_view path, std::string_view entry, std::string_view type);
\ No newline at end of file
+// defines is a null terminated array of macros, it allows compiling variants of the same shader.
+[[nodiscard]] std::pair<ID3DBlob*, D3D12_SHADER_BYTECODE> LoadShader(std::string_view path, std::string_view entry, std::string_view type, D3D_SHADER_MACRO const * defines = nullptr);
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "d3d12_residency_device.hpp"
+
+D3D12ResidencyDevice::D3D12ResidencyDevice(ComPtr<ID3D12Device> device, ComPtr<IDXGIAdapter1> adapter)
+	: device(device)
+{
+	adapter.As(&this->adapter);
+}
+
+HRESULT D3D12ResidencyDevice::MakeResident(UINT num_objects, ID3D12Pageable* const * objects)
+{
+	return device->MakeResident(num_objects, objects);
+}
+
+HRESULT D3D12ResidencyDevice::Evict(UINT num_objects, ID3D12Pageable* const * objects)
+{
+	return device->Evict(num_objects, objects);
+}
+
+HRESULT D3D12ResidencyDevice::QueryBudget(MemorySegment segment, UINT64& budget)
+{
+	if (!adapter)
+		return E_NOINTERFACE;
+
+	auto group = segment == MemorySegment::Local ? DXGI_MEMORY_SEGMENT_GROUP_LOCAL : DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL;
+	DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+	HRESULT hr = adapter->QueryVideoMemoryInfo(0, group, &info);
+	budget = info.Budget;
+	return hr;
+}
+
+MemorySegment GetMemorySegment(ID3D12Device* device, ID3D12Resource* resource)
+{
+	D3D12_FEATURE_DATA_ARCHITECTURE architecture = {};
+	HRESULT hr = device->CheckFeatureSupport(D3D12_FEATURE_ARCHITECTURE, &architecture, sizeof(architecture));
+	if (SUCCEEDED(hr) && architecture.UMA)
+		return MemorySegment::Local;
+
+	D3D12_HEAP_PROPERTIES properties;
+	hr = resource->GetHeapProperties(&properties, nullptr);
+	if (FAILED(hr))
+	{
+		throw "Failed to get the heap properties of a resource";
+	}
+
+	return properties.Type == D3D12_HEAP_TYPE_DEFAULT ? MemorySegment::Local : MemorySegment::NonLocal;
+}
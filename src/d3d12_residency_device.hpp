@@ -0,0 +1,24 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+#include "residency_manager.hpp"
+
+// Forwards the residency calls to the device and asks the adapter for the budget.
+class D3D12ResidencyDevice : public ResidencyDevice
+{
+public:
+	D3D12ResidencyDevice(ComPtr<ID3D12Device> device, ComPtr<IDXGIAdapter1> adapter);
+
+	HRESULT MakeResident(UINT num_objects, ID3D12Pageable* const * objects) override;
+	HRESULT Evict(UINT num_objects, ID3D12Pageable* const * objects) override;
+	HRESULT QueryBudget(MemorySegment segment, UINT64& budget) override;
+
+private:
+	ComPtr<ID3D12Device> device;
+	// Null if the adapter doesn't implement IDXGIAdapter3, which is needed to query the budget.
+	ComPtr<IDXGIAdapter3> adapter;
+};
+
+// Default heaps live in local memory on discrete adapters, upload and readback heaps in system memory.
+// UMA adapters only have the local segment.
+MemorySegment GetMemorySegment(ID3D12Device* device, ID3D12Resource* resource);
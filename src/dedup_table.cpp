@@ -0,0 +1,94 @@
+#include "dedup_table.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// FNV-1a, the payloads are small enough that anything fancier doesn't pay off.
+static std::uint64_t HashPayload(std::uint8_t const * data, std::uint32_t size)
+{
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	for (std::uint32_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+DedupTable::DedupTable(std::uint32_t capacity, std::uint32_t payload_size)
+	: capacity(capacity),
+	payload_size(payload_size),
+	payloads((std::size_t)capacity * payload_size)
+{
+	std::uint64_t size = 1;
+	while (size < (std::uint64_t)capacity * 2)
+		size <<= 1;
+	entries.assign(size, { 0, 0, 0 });
+	mask = size - 1;
+}
+
+void DedupTable::Clear()
+{
+	num_slots = 0;
+	clears++;
+
+	// Only wipe the table once the generation wraps around.
+	if (++generation == 0)
+	{
+		std::fill(entries.begin(), entries.end(), Entry{ 0, 0, 0 });
+		generation = 1;
+	}
+}
+
+std::uint32_t DedupTable::Insert(void const * payload, bool& found)
+{
+	auto data = static_cast<std::uint8_t const *>(payload);
+	auto hash = HashPayload(data, payload_size);
+	lookups++;
+
+	// Linear probing, the table is never more than half full so there always is an empty entry.
+	for (auto i = hash & mask;; i = (i + 1) & mask)
+	{
+		probes++;
+		auto& entry = entries[i];
+		if (entry.generation != generation)
+		{
+			if (num_slots == capacity)
+			{
+				throw "Deduplication table is full";
+			}
+
+			entry = { hash, num_slots, generation };
+			std::memcpy(payloads.data() + (std::size_t)num_slots * payload_size, data, payload_size);
+			found = false;
+			return num_slots++;
+		}
+
+		if (entry.hash == hash && std::memcmp(payloads.data() + (std::size_t)entry.slot * payload_size, data, payload_size) == 0)
+		{
+			hits++;
+			found = true;
+			return entry.slot;
+		}
+	}
+}
+
+std::uint64_t DedupTable::GetLookups() const
+{
+	return lookups;
+}
+
+std::uint64_t DedupTable::GetHits() const
+{
+	return hits;
+}
+
+std::uint64_t DedupTable::GetProbes() const
+{
+	return probes;
+}
+
+std::uint64_t DedupTable::GetClears() const
+{
+	return clears;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Open addressing hash table from fixed size payloads to the slot that holds the first copy of them.
+// Identical payloads get the same slot, new ones the next free slot, so the slots stay densely packed.
+class DedupTable
+{
+public:
+	// Holds up to capacity distinct payloads of payload_size bytes between two calls to Clear.
+	DedupTable(std::uint32_t capacity, std::uint32_t payload_size);
+
+	// Forgets every payload without touching the table.
+	void Clear();
+	// Returns the slot of an identical payload inserted since the last Clear and sets found,
+	// otherwise remembers the payload and returns the next free slot.
+	std::uint32_t Insert(void const * payload, bool& found);
+
+	std::uint64_t GetLookups() const;
+	std::uint64_t GetHits() const;
+	// Entries looked at over all lookups, 1 per lookup without collisions.
+	std::uint64_t GetProbes() const;
+	std::uint64_t GetClears() const;
+
+private:
+	struct Entry
+	{
+		std::uint64_t hash;
+		std::uint32_t slot;
+		// Entries of older generations are empty.
+		std::uint32_t generation;
+	};
+
+	std::uint32_t capacity;
+	std::uint32_t payload_size;
+	// Power of two and at most half full, so the probe sequences stay short.
+	std::vector<Entry> entries;
+	std::uint64_t mask;
+	std::uint32_t generation = 1;
+	std::uint32_t num_slots = 0;
+	// CPU copy of the payload in every slot. The slots themselves are usually write combined memory.
+	std::vector<std::uint8_t> payloads;
+
+	std::uint64_t lookups = 0;
+	std::uint64_t hits = 0;
+	std::uint64_t probes = 0;
+	std::uint64_t clears = 0;
+};
@@ -0,0 +1,106 @@
+#include "deferred_release.hpp"
+
+DeferredReleaseQueue::DeferredReleaseQueue(bool background_thread)
+	: stop(false)
+{
+	if (background_thread)
+	{
+		thread = std::thread(&DeferredReleaseQueue::ReleaseLoop, this);
+	}
+}
+
+DeferredReleaseQueue::~DeferredReleaseQueue()
+{
+	if (thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		cv.notify_one();
+		thread.join();
+	}
+
+	// The owner is responsible for making sure the GPU is idle at this point.
+	std::vector<Entry> batch(std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+	pending.clear();
+	Release(batch);
+}
+
+void DeferredReleaseQueue::Retire(ComPtr<IUnknown> object, UINT64 fence_value)
+{
+	pending.push_back({ fence_value, std::move(object), nullptr });
+}
+
+void DeferredReleaseQueue::Retire(std::function<void()> release, UINT64 fence_value)
+{
+	pending.push_back({ fence_value, nullptr, std::move(release) });
+}
+
+void DeferredReleaseQueue::Collect(UINT64 completed_value)
+{
+	std::vector<Entry> batch;
+	while (!pending.empty() && pending.front().fence_value <= completed_value)
+	{
+		batch.push_back(std::move(pending.front()));
+		pending.pop_front();
+	}
+
+	if (batch.empty())
+	{
+		return;
+	}
+
+	if (!thread.joinable())
+	{
+		Release(batch);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::move(batch.begin(), batch.end(), std::back_inserter(to_release));
+	}
+	cv.notify_one();
+}
+
+std::size_t DeferredReleaseQueue::GetNumPending() const
+{
+	return pending.size();
+}
+
+void DeferredReleaseQueue::ReleaseLoop()
+{
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+
+	while (true)
+	{
+		std::vector<Entry> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return stop || !to_release.empty(); });
+
+			batch.swap(to_release);
+			if (batch.empty() && stop)
+			{
+				return;
+			}
+		}
+
+		Release(batch);
+	}
+}
+
+void DeferredReleaseQueue::Release(std::vector<Entry>& batch)
+{
+	for (auto& entry : batch)
+	{
+		if (entry.release)
+		{
+			entry.release();
+		}
+	}
+
+	// Drops the last references.
+	batch.clear();
+}
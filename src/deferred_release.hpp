@@ -0,0 +1,53 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps objects alive until the GPU passed the fence value of the last frame that used them.
+// Values have to be retired in increasing order, which is always the case with a timeline fence.
+class DeferredReleaseQueue
+{
+public:
+	// With a background thread the actual release happens on a low priority thread instead of in Collect.
+	explicit DeferredReleaseQueue(bool background_thread);
+	~DeferredReleaseQueue();
+
+	DeferredReleaseQueue(DeferredReleaseQueue const &) = delete;
+	DeferredReleaseQueue& operator=(DeferredReleaseQueue const &) = delete;
+
+	// Resources, heaps, descriptor heaps, anything reference counted.
+	void Retire(ComPtr<IUnknown> object, UINT64 fence_value);
+	// Anything else, for example a range of a heap or a descriptor that has to go back to its allocator.
+	void Retire(std::function<void()> release, UINT64 fence_value);
+
+	// Releases everything that was retired with a value up to completed_value.
+	void Collect(UINT64 completed_value);
+
+	std::size_t GetNumPending() const;
+
+private:
+	struct Entry
+	{
+		UINT64 fence_value;
+		ComPtr<IUnknown> object;
+		std::function<void()> release;
+	};
+
+	void ReleaseLoop();
+	static void Release(std::vector<Entry>& batch);
+
+	std::deque<Entry> pending;
+
+	// Background thread
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<Entry> to_release;
+	bool stop;
+};
@@ -0,0 +1,73 @@
+#include "draw_queue.hpp"
+
+#include <algorithm>
+#include <array>
+
+std::uint64_t DrawQueue::MakeKey(std::uint32_t pipeline, std::uint32_t root_signature, std::uint32_t geometry, std::uint32_t material, float depth)
+{
+	float clamped = (std::min)((std::max)(depth, 0.0f), 1.0f);
+	auto quantized_depth = static_cast<std::uint64_t>(clamped * 0xffffff);
+
+	return (std::uint64_t(pipeline & 0xff) << 56)
+		| (std::uint64_t(root_signature & 0xf) << 52)
+		| (std::uint64_t(geometry & 0xfff) << 40)
+		| (std::uint64_t(material & 0xffff) << 24)
+		| quantized_depth;
+}
+
+void DrawQueue::Clear()
+{
+	draws.clear();
+}
+
+void DrawQueue::Push(std::uint64_t key, std::uint32_t idx)
+{
+	draws.push_back({ key, idx });
+}
+
+void DrawQueue::Sort()
+{
+	constexpr std::size_t num_passes = sizeof(std::uint64_t);
+	constexpr std::size_t num_buckets = 256;
+
+	// Build the histograms of every pass with a single read of the keys.
+	std::array<std::array<std::uint32_t, num_buckets>, num_passes> histograms = {};
+	for (auto const & draw : draws)
+	{
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			histograms[pass][(draw.key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	scratch.resize(draws.size());
+	for (std::size_t pass = 0; pass < num_passes; pass++)
+	{
+		auto& histogram = histograms[pass];
+		std::size_t shift = pass * 8;
+
+		// Every key has the same digit, the pass wouldn't change the order.
+		if (draws.empty() || histogram[(draws[0].key >> shift) & 0xff] == draws.size())
+			continue;
+
+		std::array<std::uint32_t, num_buckets> offsets;
+		std::uint32_t sum = 0;
+		for (std::size_t i = 0; i < num_buckets; i++)
+		{
+			offsets[i] = sum;
+			sum += histogram[i];
+		}
+
+		for (auto const & draw : draws)
+		{
+			scratch[offsets[(draw.key >> shift) & 0xff]++] = draw;
+		}
+
+		draws.swap(scratch);
+	}
+}
+
+std::vector<DrawQueue::Draw> const & DrawQueue::GetDraws() const
+{
+	return draws;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Orders the draws of a frame so draws that share state end up next to each other.
+// The key is, from most to least significant: pipeline (8 bits), root signature (4 bits), geometry (12 bits), material (16 bits), depth (24 bits).
+class DrawQueue
+{
+public:
+	// Bits of the key that select state. Draws that share them can be drawn as instances of each other.
+	static constexpr std::uint64_t state_mask = ~0ull << 40;
+
+	struct Draw
+	{
+		std::uint64_t key;
+		std::uint32_t idx;
+	};
+
+	// depth is expected in [0, 1], closer draws sort first.
+	static std::uint64_t MakeKey(std::uint32_t pipeline, std::uint32_t root_signature, std::uint32_t geometry, std::uint32_t material, float depth);
+
+	// Keeps the memory so the queue doesn't allocate once it reached its size.
+	void Clear();
+	void Push(std::uint64_t key, std::uint32_t idx);
+	// Stable LSD radix sort, 8 bits per pass. Passes where every key has the same digit are skipped.
+	void Sort();
+
+	std::vector<Draw> const & GetDraws() const;
+
+private:
+	std::vector<Draw> draws;
+	std::vector<Draw> scratch;
+};
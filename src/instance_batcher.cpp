@@ -0,0 +1,149 @@
+#include "instance_batcher.hpp"
+
+#include "api_interposer.hpp"
+#include "memory_accounting.hpp"
+
+InstanceBatcher::InstanceBatcher(ComPtr<ID3D12Device> device, std::uint32_t page_size, std::uint32_t stride, std::wstring name)
+	: device(device),
+	page_size(page_size),
+	stride(stride),
+	instances_per_page(page_size / stride),
+	name(name),
+	cursor(0),
+	prev_state(0)
+{
+}
+
+void InstanceBatcher::Begin(UINT64 completed_fence_value)
+{
+	while (!in_flight.empty() && in_flight.front().fence_value <= completed_fence_value)
+	{
+		free_pages.push_back(in_flight.front().page);
+		in_flight.pop_front();
+	}
+
+	frame_pages.clear();
+	batches.clear();
+	cursor = instances_per_page;
+}
+
+void* InstanceBatcher::Add(std::uint64_t state, std::uint32_t object)
+{
+	bool new_batch = batches.empty() || state != prev_state;
+	if (cursor == instances_per_page)
+	{
+		NextPage();
+		new_batch = true;
+	}
+
+	if (new_batch)
+	{
+		batches.push_back({ object, static_cast<std::uint32_t>(frame_pages.size() - 1), cursor, 0 });
+		prev_state = state;
+	}
+	batches.back().count++;
+
+	return frame_pages.back()->address + (std::size_t)stride * cursor++;
+}
+
+void InstanceBatcher::End(UINT64 fence_value)
+{
+	// Frames are submitted in order, so the in flight pages stay sorted by fence value.
+	for (auto page : frame_pages)
+	{
+		in_flight.push_back({ page, fence_value });
+	}
+	num_last_frame_pages = frame_pages.size();
+	frame_pages.clear();
+}
+
+std::vector<InstanceBatch> const & InstanceBatcher::GetBatches() const
+{
+	return batches;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS InstanceBatcher::GetPageAddress(std::uint32_t page) const
+{
+	return frame_pages[page]->gpu_address;
+}
+
+std::uint32_t InstanceBatcher::GetInstancesPerPage() const
+{
+	return instances_per_page;
+}
+
+std::size_t InstanceBatcher::GetNumPagesCreated() const
+{
+	return pages.size();
+}
+
+ID3D12Resource* InstanceBatcher::GetPage(std::size_t idx) const
+{
+	return pages[idx].buffer.Get();
+}
+
+std::vector<ID3D12Resource*> InstanceBatcher::GetFramePages() const
+{
+	std::vector<ID3D12Resource*> result;
+	for (auto page : frame_pages)
+		result.push_back(page->buffer.Get());
+	return result;
+}
+
+std::vector<ID3D12Resource*> InstanceBatcher::GetPagesToReuse() const
+{
+	// NextPage takes them from the back.
+	std::vector<ID3D12Resource*> result;
+	for (std::size_t i = 0; i < num_last_frame_pages && i < free_pages.size(); i++)
+		result.push_back(free_pages[free_pages.size() - 1 - i]->buffer.Get());
+	return result;
+}
+
+void InstanceBatcher::NextPage()
+{
+	Page* page;
+	if (!free_pages.empty())
+	{
+		page = free_pages.back();
+		free_pages.pop_back();
+	}
+	else
+	{
+		page = Create();
+	}
+
+	frame_pages.push_back(page);
+	cursor = 0;
+}
+
+InstanceBatcher::Page* InstanceBatcher::Create()
+{
+	pages.emplace_back();
+	auto& page = pages.back();
+
+	HRESULT hr = interposer::CreateCommittedResource(
+		device.Get(),
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(page_size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&page.buffer));
+	if (FAILED(hr))
+	{
+		throw "Failed to create instance page";
+	}
+	page.buffer->SetName(name.c_str());
+	memory::Allocate(memory::Category::ConstantData, page_size, memory::GetAllocatedSize(device.Get(), page.buffer.Get()));
+
+	// Stays mapped, upload heaps can be written while the GPU reads other parts of them.
+	CD3DX12_RANGE read_range(0, 0);
+	hr = page.buffer->Map(0, &read_range, reinterpret_cast<void**>(&page.address));
+	if (FAILED(hr))
+	{
+		throw "Failed to map instance page";
+	}
+	page.gpu_address = page.buffer->GetGPUVirtualAddress();
+
+	return &page;
+}
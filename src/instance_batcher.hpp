@@ -0,0 +1,79 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+
+#include <deque>
+#include <vector>
+
+// Consecutive instances that share state and live in the same page.
+struct InstanceBatch
+{
+	std::uint32_t object; // First object of the batch, all of them share its state.
+	std::uint32_t page;
+	std::uint32_t first; // Instance index within the page.
+	std::uint32_t count;
+};
+
+// Packs per instance data of a frame into upload pages and groups it into batches that can be drawn with a single instanced draw.
+// Pages are recycled once the GPU passed the fence value of the frame that used them, so there is one ring of pages for all frames in flight.
+class InstanceBatcher
+{
+public:
+	InstanceBatcher(ComPtr<ID3D12Device> device, std::uint32_t page_size, std::uint32_t stride, std::wstring name = L"Instance Page");
+
+	InstanceBatcher(InstanceBatcher const &) = delete;
+	InstanceBatcher& operator=(InstanceBatcher const &) = delete;
+
+	// Starts a frame and recycles the pages the GPU is done with.
+	void Begin(UINT64 completed_fence_value);
+	// Returns where the data of the instance goes. A new batch starts when state differs from the previous instance or the page is full.
+	[[nodiscard]] void* Add(std::uint64_t state, std::uint32_t object);
+	// The pages of this frame won't be reused before the fence reaches fence_value.
+	void End(UINT64 fence_value);
+
+	std::vector<InstanceBatch> const & GetBatches() const;
+	D3D12_GPU_VIRTUAL_ADDRESS GetPageAddress(std::uint32_t page) const;
+	std::uint32_t GetInstancesPerPage() const;
+	std::size_t GetNumPagesCreated() const;
+
+	// Pages in the order they were created, up to GetNumPagesCreated.
+	ID3D12Resource* GetPage(std::size_t idx) const;
+	// Pages the current frame filled so far.
+	std::vector<ID3D12Resource*> GetFramePages() const;
+	// The free pages the frame takes first, as many as the last frame used. Call after Begin.
+	std::vector<ID3D12Resource*> GetPagesToReuse() const;
+
+private:
+	struct Page
+	{
+		ComPtr<ID3D12Resource> buffer;
+		std::uint8_t* address;
+		D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
+	};
+
+	struct InFlight
+	{
+		Page* page;
+		UINT64 fence_value;
+	};
+
+	void NextPage();
+	Page* Create();
+
+	ComPtr<ID3D12Device> device;
+	std::uint32_t page_size;
+	std::uint32_t stride;
+	std::uint32_t instances_per_page;
+	std::wstring name;
+
+	std::deque<Page> pages; // Deque so the pointers stay valid.
+	std::vector<Page*> free_pages;
+	std::deque<InFlight> in_flight;
+
+	// Current frame
+	std::vector<Page*> frame_pages;
+	std::size_t num_last_frame_pages = 0;
+	std::vector<InstanceBatch> batches;
+	std::uint32_t cursor;
+	std::uint64_t prev_state;
+};
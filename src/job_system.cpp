@@ -0,0 +1,241 @@
+#include "job_system.hpp"
+
+namespace
+{
+	// Index of the queue owned by the current thread. Threads outside the pool use the last queue.
+	thread_local std::int32_t tls_worker_idx = -1;
+}
+
+Task* TaskGraph::Add(char const * name, std::function<void()> func)
+{
+	tasks.emplace_back(name, std::move(func));
+	tasks.back().graph = this;
+	return &tasks.back();
+}
+
+void TaskGraph::AddDependency(Task* before, Task* after)
+{
+	before->successors.push_back(after);
+	after->pending++;
+}
+
+void TaskGraph::Clear()
+{
+	tasks.clear();
+}
+
+void TaskGraph::ReportToProfiler() const
+{
+	for (auto const & task : tasks)
+	{
+		if (!task.name)
+			continue;
+
+		auto& result = profiler::cpu_results[task.name];
+		result.start.push_back(task.start);
+		result.end.push_back(task.end);
+	}
+}
+
+JobSystem::JobSystem(std::uint32_t num_workers)
+	: queues(new WorkerQueue[num_workers + 1]),
+	num_queues(num_workers + 1),
+	queued_tasks(0),
+	stop(false)
+{
+	workers.reserve(num_workers);
+	for (std::uint32_t i = 0; i < num_workers; i++)
+	{
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stop = true;
+	}
+	sleep_cv.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void JobSystem::Run(TaskGraph& graph)
+{
+	graph.remaining = graph.tasks.size();
+
+	// Release the submit reference. Tasks without dependencies become ready immediately.
+	for (auto& task : graph.tasks)
+	{
+		if (--task.pending == 0)
+		{
+			Push(&task);
+		}
+	}
+
+	// Help instead of blocking so the calling thread isn't wasted.
+	std::uint32_t queue_idx = GetCurrentQueueIdx();
+	while (graph.remaining.load() != 0)
+	{
+		if (Task* task = FindTask(queue_idx))
+		{
+			Execute(task, queue_idx);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::ParallelFor(std::size_t count, std::uint32_t num_chunks, RangeFunc const & func)
+{
+	// Nothing to distribute, skip the scheduling cost.
+	if (num_chunks <= 1 || workers.empty())
+	{
+		for (std::uint32_t i = 0; i < num_chunks; i++)
+		{
+			func(count * i / num_chunks, count * (i + 1) / num_chunks, i);
+		}
+		return;
+	}
+
+	TaskGraph graph;
+	for (std::uint32_t i = 0; i < num_chunks; i++)
+	{
+		std::size_t begin = count * i / num_chunks;
+		std::size_t end = count * (i + 1) / num_chunks;
+		graph.Add(nullptr, [&func, begin, end, i] { func(begin, end, i); });
+	}
+
+	Run(graph);
+}
+
+std::uint32_t JobSystem::GetNumThreads() const
+{
+	return static_cast<std::uint32_t>(workers.size()) + 1;
+}
+
+void JobSystem::WorkerLoop(std::uint32_t worker_idx)
+{
+	tls_worker_idx = static_cast<std::int32_t>(worker_idx);
+
+	while (!stop)
+	{
+		if (Task* task = FindTask(worker_idx))
+		{
+			Execute(task, worker_idx);
+			continue;
+		}
+
+		// Spin for a bit before going to sleep, new tasks usually arrive in bursts.
+		bool found_work = false;
+		for (auto i = 0; i < 64; i++)
+		{
+			if (queued_tasks.load() > 0)
+			{
+				found_work = true;
+				break;
+			}
+			std::this_thread::yield();
+		}
+
+		if (!found_work)
+		{
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			sleep_cv.wait(lock, [this] { return stop || queued_tasks.load() > 0; });
+		}
+	}
+}
+
+void JobSystem::Push(Task* task)
+{
+	queued_tasks++;
+
+	std::int32_t worker_idx = tls_worker_idx;
+	if (worker_idx >= 0)
+	{
+		auto& queue = queues[worker_idx];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+	else if (!injection_queue.Push(task))
+	{
+		// Injection queue is full, fall back to the queue of the external threads.
+		auto& queue = queues[num_queues - 1];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	sleep_cv.notify_one();
+}
+
+Task* JobSystem::FindTask(std::uint32_t queue_idx)
+{
+	Task* task = nullptr;
+
+	// Own queue first, newest task first since its data is most likely still in cache.
+	{
+		auto& queue = queues[queue_idx];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+	}
+
+	if (!task)
+	{
+		injection_queue.Pop(task);
+	}
+
+	// Steal the oldest task of another queue.
+	for (std::uint32_t i = 1; !task && i < num_queues; i++)
+	{
+		auto& queue = queues[(queue_idx + i) % num_queues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (task)
+	{
+		queued_tasks--;
+	}
+
+	return task;
+}
+
+void JobSystem::Execute(Task* task, std::uint32_t worker_idx)
+{
+	task->worker_idx = worker_idx;
+	task->start = profiler::Now();
+	task->func();
+	task->end = profiler::Now();
+
+	for (auto successor : task->successors)
+	{
+		if (--successor->pending == 0)
+		{
+			Push(successor);
+		}
+	}
+
+	task->graph->remaining--;
+}
+
+std::uint32_t JobSystem::GetCurrentQueueIdx() const
+{
+	return tls_worker_idx >= 0 ? static_cast<std::uint32_t>(tls_worker_idx) : num_queues - 1;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+
+// Bounded multi producer multi consumer queue. Used to inject tasks from threads that don't own a deque.
+template<typename T, std::size_t N>
+class MPMCQueue
+{
+	static_assert((N & (N - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	MPMCQueue() : enqueue_pos(0), dequeue_pos(0)
+	{
+		for (std::size_t i = 0; i < N; i++)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bool Push(T const & value)
+	{
+		Cell* cell;
+		std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &cells[pos & (N - 1)];
+			std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+			std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+
+			if (diff == 0)
+			{
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // Full
+			}
+			else
+			{
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = value;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& value)
+	{
+		Cell* cell;
+		std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &cells[pos & (N - 1)];
+			std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+			std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+
+			if (diff == 0)
+			{
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // Empty
+			}
+			else
+			{
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = cell->data;
+		cell->sequence.store(pos + N, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<std::size_t> sequence;
+		T data;
+	};
+
+	std::array<Cell, N> cells;
+	alignas(64) std::atomic<std::size_t> enqueue_pos;
+	alignas(64) std::atomic<std::size_t> dequeue_pos;
+};
+
+class TaskGraph;
+
+struct Task
+{
+	Task(char const * name, std::function<void()> func) : name(name), func(std::move(func)), pending(1), graph(nullptr), worker_idx(0) {}
+
+	char const * name; // Tasks without a name are not instrumented.
+	std::function<void()> func;
+
+	// Unfinished dependencies. Starts at 1 so the task can't run before the graph is submitted.
+	std::atomic<std::int32_t> pending;
+	std::vector<Task*> successors;
+	TaskGraph* graph;
+
+	profiler::TimePoint start;
+	profiler::TimePoint end;
+	std::uint32_t worker_idx;
+};
+
+// Tasks and their dependencies. A graph has to be fully built before it is run.
+class TaskGraph
+{
+public:
+	Task* Add(char const * name, std::function<void()> func);
+	// after won't start before before is finished.
+	void AddDependency(Task* before, Task* after);
+	void Clear();
+
+	// Appends the timings of every named task of the last run to the profiler. Call from the main thread only.
+	void ReportToProfiler() const;
+
+private:
+	friend class JobSystem;
+
+	std::deque<Task> tasks; // Deque so the tasks never move.
+	std::atomic<std::size_t> remaining;
+};
+
+// Work stealing scheduler. Every worker owns a deque, threads without one inject tasks through a lock free queue.
+class JobSystem
+{
+public:
+	using RangeFunc = std::function<void(std::size_t begin, std::size_t end, std::uint32_t chunk_idx)>;
+
+	explicit JobSystem(std::uint32_t num_workers);
+	~JobSystem();
+
+	JobSystem(JobSystem const &) = delete;
+	JobSystem& operator=(JobSystem const &) = delete;
+
+	// Runs every task of the graph and blocks until they are all finished. The calling thread helps executing tasks.
+	void Run(TaskGraph& graph);
+
+	// Splits [0, count) into num_chunks contiguous ranges and blocks until all of them are executed.
+	// Every chunk is executed exactly once, even when its range is empty.
+	void ParallelFor(std::size_t count, std::uint32_t num_chunks, RangeFunc const & func);
+
+	// Number of threads that can execute tasks (workers + the calling thread).
+	std::uint32_t GetNumThreads() const;
+
+private:
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Task*> tasks;
+	};
+
+	void WorkerLoop(std::uint32_t worker_idx);
+	void Push(Task* task);
+	Task* FindTask(std::uint32_t worker_idx);
+	void Execute(Task* task, std::uint32_t worker_idx);
+	std::uint32_t GetCurrentQueueIdx() const;
+
+	std::vector<std::thread> workers;
+	// One queue per worker plus one for threads outside the pool.
+	std::unique_ptr<WorkerQueue[]> queues;
+	std::uint32_t num_queues;
+	MPMCQueue<Task*, 4096> injection_queue;
+
+	std::atomic<std::int32_t> queued_tasks;
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+	std::atomic<bool> stop;
+};
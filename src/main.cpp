@@ -2,8 +2,112 @@
 
 #include "profiler.hpp"
 
-BufferPerfApp::BufferPerfApp()
-	: clear_color{ 0.568f, 0.733f, 1.0f, 1.0f },
+// Smallest number of objects that starts on a new cache line in both the scene array and the mapped constant buffer memory.
+// Parallel chunks are a multiple of this so no two threads ever write to the same cache line.
+static constexpr std::size_t cache_line = 64;
+static constexpr std::size_t granularity = std::lcm(
+	cache_line / std::gcd(sizeof(RenderObject), cache_line),
+	cache_line / std::gcd(std::size_t((sizeof(CBPerObject) + 255) & ~255), cache_line));
+
+// Describes the compile time configuration for the reports.
+static std::string GetStrategyName(std::uint32_t frames_in_flight)
+{
+	std::string name;
+#ifdef INSTANCING
+	name += "instanced structured buffer";
+#elif defined INSTANCE_VERTEX_BUFFER
+	name += "instance vertex buffer";
+#elif defined VERTEX_PULLING
+	name += "vertex pulling";
+#elif defined CB_ARRAY
+	name += "constant buffer array";
+#elif defined CB_DELTA_SCATTER
+	name += "default heap, delta scatter";
+#elif defined CB_DEFAULT_HEAP
+	name += "default heap";
+#elif defined CB_BIG_BUFFER
+	name += "big buffer";
+#else
+	name += "buffer per object";
+#endif
+#ifdef CB_PARTITIONS
+	name += ", partitioned by update frequency";
+#endif
+#ifdef CB_DEDUP
+	name += ", deduplicated";
+#endif
+#ifdef CB_PAYLOAD_HALF
+	name += ", half position and unorm color";
+#elif defined CB_PAYLOAD_QUANTIZED
+	name += ", quantized position and unorm color";
+#endif
+#ifdef CB_MAP_ON_CREATION
+	name += ", mapped on creation";
+#elif defined CB_MAP_RANGE_TRACKING
+	name += ", mapped once per frame with tracked ranges";
+#elif defined CB_UNMAP
+	name += ", mapped and unmapped on update";
+#else
+	name += ", mapped on update";
+#endif
+	name += ", " + std::to_string(frames_in_flight) + " frames in flight";
+	name += ", " + std::to_string(NUM_RENDER_OBJECTS) + " objects";
+	return name;
+}
+
+#if defined VERTEX_PULLING
+// Root parameters: 0 first instance of the batch, 1 vertices, 2 instance data of the page
+static constexpr UINT instance_page_parameter = 2;
+#elif defined INSTANCING
+// Root parameters: 0 first instance of the batch, 1 instance data of the page
+static constexpr UINT instance_page_parameter = 1;
+#elif defined CB_ARRAY
+// Root parameters: 0 index of the object within the page, 1 the page as constant buffer
+static constexpr UINT instance_page_parameter = 1;
+#endif
+
+#ifdef CB_PAYLOAD_COMPACT
+// The vertex shader decodes the position, the pixel shader the color.
+static constexpr D3D12_SHADER_VISIBILITY object_cb_visibility = D3D12_SHADER_VISIBILITY_ALL;
+#else
+static constexpr D3D12_SHADER_VISIBILITY object_cb_visibility = D3D12_SHADER_VISIBILITY_PIXEL;
+#endif
+
+#ifdef CB_PAYLOAD_QUANTIZED
+// The origin of the quantized positions comes after the constant buffers.
+static constexpr UINT num_payload_parameters = 1;
+#ifdef CB_PARTITIONS
+static constexpr UINT payload_origin_parameter = 3;
+#else
+static constexpr UINT payload_origin_parameter = 1;
+#endif
+#else
+static constexpr UINT num_payload_parameters = 0;
+#endif
+
+// Macros for cb_vertex.hlsl and cb_pixel.hlsl, null terminated.
+static std::vector<D3D_SHADER_MACRO> GetConstantBufferDefines(bool payload_encoding)
+{
+	std::vector<D3D_SHADER_MACRO> defines;
+#ifdef CB_PARTITIONS
+	defines.push_back({ "CB_PARTITIONS", "1" });
+#endif
+	if (payload_encoding)
+	{
+#ifdef CB_PAYLOAD_HALF
+		defines.push_back({ "CB_PAYLOAD_HALF", "1" });
+#elif defined CB_PAYLOAD_QUANTIZED
+		defines.push_back({ "CB_PAYLOAD_QUANTIZED", "1" });
+#endif
+	}
+	defines.push_back({ nullptr, nullptr });
+	return defines;
+}
+
+BufferPerfApp::BufferPerfApp(std::uint32_t frames_in_flight)
+	: job_system(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0),
+	frames_in_flight(frames_in_flight),
+	clear_color{ 0.568f, 0.733f, 1.0f, 1.0f },
 	frames(0),
 	framerate(0)
 {
@@ -14,22 +118,96 @@ BufferPerfApp::BufferPerfApp()
 
 BufferPerfApp::~BufferPerfApp()
 {
+#ifdef PIPELINED_SIMULATION
+	{
+		std::lock_guard<std::mutex> lock(sim_mutex);
+		sim_running = false;
+	}
+	sim_wakeup.notify_all();
+	sim_thread.join();
+	PerfOutput_Pipeline();
+#endif
+
+#ifdef FRAME_TASK_GRAPH
+	for (auto name : { "task_wait", "task_pre_pass", "task_update", "task_cull", "task_record", "task_submit" })
+		profiler::PrintResult(name);
+#ifdef DRAW_SORTING
+	profiler::PrintResult("task_sort");
+#endif
+#ifdef CB_DEFAULT_HEAP
+	profiler::PrintResult("task_upload");
+#endif
+#ifdef CB_PARTITIONS
+	profiler::PrintResult("task_frame_constants");
+	profiler::PrintResult("task_materials");
+#endif
+#ifdef CB_MAP_RANGE_TRACKING
+	profiler::PrintResult("task_unmap");
+#endif
+#else
 	profiler::PrintResult("drawing");
 	profiler::PrintResult("update");
+#ifdef CB_DEFAULT_HEAP
+	profiler::PrintResult("constant_upload");
+#endif
+#ifdef CB_PARTITIONS
+	profiler::PrintResult("frame_constants");
+	profiler::PrintResult("materials");
+#endif
+#if defined DRAW_SORTING && !defined INSTANCE_BATCHING
+	profiler::PrintResult("draw_sort");
+#endif
+#endif
+#ifdef INSTANCE_BATCHING
+	PerfOutput_Instancing();
+#endif
+#ifdef CB_DEFAULT_HEAP
+	PerfOutput_ConstantUploads();
+#endif
+#ifdef CB_PARTITIONS
+	PerfOutput_Partitions();
+#endif
+#ifdef CB_DEDUP
+	PerfOutput_Dedup();
+#endif
+#ifdef CB_PAYLOAD_COMPACT
+	PerfOutput_Payload();
+#endif
+#ifdef CB_BUNDLES
+	profiler::PrintResult("bundle_record");
+#endif
+#ifdef SPLIT_SUBMISSION
+	PerfOutput_SplitSubmission();
+#endif
 	profiler::PrintResult("full_frame");
 	PerfOutput_Framerate();
+	memory::PrintResults("perf_memory.txt", GetStrategyName(frames_in_flight));
+#ifdef PARALLEL_UPDATE_SWEEP
+	PerfOutput_UpdateScaling();
+#endif
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	PerfOutput_FramesInFlight();
+#endif
 
 	// Wait for all command lists to be finished
-	for (auto i = 0; i < fences.size(); i++) {
-		if (fences[i]->GetCompletedValue() < fence_values[i])
-		{
-			HRESULT hr = fences[i]->SetEventOnCompletion(fence_values[i], fence_event);
-			WaitForSingleObject(fence_event, INFINITE);
-		}
+	fence->Flush("shutdown");
 
-		fence_values[i]++;
+	for (auto& obj : draw_list)
+	{
+		RetireConstantBuffer(obj.const_buffer);
+		obj.const_buffer = nullptr;
 	}
-
+	release_queue->Collect(fence->GetLastSignaledValue());
+	fence->PrintStalls("perf_fence_stalls.txt");
+#if defined API_INTERPOSER || defined STATE_FILTERING
+	interposer::PrintResults("perf_api_calls.txt");
+#endif
+#ifdef RESIDENCY_MANAGEMENT
+	residency->PrintStats("perf_residency.txt");
+#endif
+#ifdef CB_MAP_RANGE_TRACKING
+	map_tracker->PrintStats("perf_map_ranges.txt");
+#endif
 }
 
 void BufferPerfApp::Init()
@@ -41,192 +219,1484 @@ void BufferPerfApp::Init()
 	render_targets = GetRenderTargetsFromSwapChain<num_backbuffers>(device, swap_chain);
 	render_target_view_heap = CreateRenderTargetViewHeap(device, num_backbuffers);
 	CreateRTVsFromResourceArray(device, render_targets, render_target_view_heap->GetCPUDescriptorHandleForHeapStart());
+	memory::Allocate(memory::Category::Descriptors, num_backbuffers * rtv_increment_size, num_backbuffers * rtv_increment_size);
 
 	depth_stencil_view_heap = CreateDepthStencilHeap(device, 1);
+	memory::Allocate(memory::Category::Descriptors, dsv_increment_size, dsv_increment_size);
 	depth_stencil_buffer = CreateDepthStencilBuffer(device, depth_stencil_view_heap->GetCPUDescriptorHandleForHeapStart(), GetWindowSize());
 
 	CreateCommandList();
 	CreateFences();
+#ifdef INSTANCE_BATCHING
+	instance_batcher = std::make_unique<InstanceBatcher>(device, INSTANCE_PAGE_SIZE, sizeof(CBPerObject), L"Instance Page");
+#endif
+#ifdef CB_DEFAULT_HEAP
+	// Lives as long as the app. It keeps a copy for the most frames in flight, so it doesn't depend on the current number.
+#ifdef CB_DELTA_SCATTER
+	auto scatter_shader = LoadShader("scatter_compute.hlsl", "main", "cs_5_0");
+	constant_uploader = std::make_unique<ConstantUploader>(device, MAX_FRAMES_IN_FLIGHT, NUM_RENDER_OBJECTS, (sizeof(CBPerObject) + 255) & ~255, sizeof(CBPayload),
+		CB_UPLOAD_RING_SIZE, FENCE_SPIN_THRESHOLD_US, scatter_shader.second);
+#else
+	constant_uploader = std::make_unique<ConstantUploader>(device, MAX_FRAMES_IN_FLIGHT, NUM_RENDER_OBJECTS, (sizeof(CBPerObject) + 255) & ~255, sizeof(CBPayload),
+		CB_UPLOAD_RING_SIZE, FENCE_SPIN_THRESHOLD_US);
+#endif
+#ifdef CB_DELTA_SCATTER_VERIFY
+	constant_uploader->EnableVerification();
+#endif
+	prev_upload_frame = profiler::Now();
+#endif
+#ifdef CB_DEDUP
+	dedup = std::make_unique<DedupTable>(NUM_RENDER_OBJECTS, sizeof(CBPayload));
+#endif
+#ifdef CB_MAP_RANGE_TRACKING
+	map_tracker = std::make_unique<MapRangeTracker>(CB_MAP_RANGE_MERGE_GAP);
+#endif
+#ifdef CB_PARTITIONS
+	// Only uploaded again when a material changes, so they always live in the default heap.
+	material_uploader = std::make_unique<ConstantUploader>(device, MAX_FRAMES_IN_FLIGHT, NUM_MATERIALS, (sizeof(CBPerMaterial) + 255) & ~255, sizeof(CBPerMaterial),
+		NUM_MATERIALS * ((sizeof(CBPerMaterial) + 255) & ~255), FENCE_SPIN_THRESHOLD_US);
+	for (std::uint32_t i = 0; i < NUM_MATERIALS; i++)
+	{
+		materials[i].color = { 1, 1 - (float)i / NUM_MATERIALS, 1, 1 };
+		material_uploader->Write(i, &materials[i]);
+	}
+#endif
 	CreateRootSignature();
 	CreatePipelineStateObject();
 
-#ifdef CB_BIG_BUFFER
-	unsigned int mul_size = (sizeof(CBPerObject) + 255) & ~255;
-	CreateBigConstantBuffer(mul_size * NUM_RENDER_OBJECTS);
-#endif
-
 	// Start recording
-	CreateVertexBuffer();
+	auto upload = direct_pool->Acquire();
+	CreateVertexBuffer(upload->list.Get());
+
+#ifdef RESIDENCY_MANAGEMENT
+	// The swap chain buffers are managed by DXGI.
+	TrackResidency(depth_stencil_buffer.Get());
+	TrackResidency(vertex_buffer.Get());
+	TrackResidency(vb_upload_heap.Get());
+#ifdef CB_DEFAULT_HEAP
+	// Copies past the current number of frames in flight are never used, so they are the first to go.
+	for (std::uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		TrackResidency(constant_uploader->GetBuffer(i));
+#endif
+#ifdef CB_PARTITIONS
+	for (std::uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		TrackResidency(material_uploader->GetBuffer(i));
+#endif
+#endif
 
 	// Now we execute the command list to upload the initial assets (triangle data)
-	cmd_list->Close();
-	std::array<ID3D12CommandList*, 1> cmd_lists = { cmd_list.Get() };
-	cmd_queue->ExecuteCommandLists(cmd_lists.size(), cmd_lists.data());
+	upload->recorder.Close();
+	std::array<ID3D12CommandList*, 1> cmd_lists = { upload->list.Get() };
+	interposer::ExecuteCommandLists(cmd_queue.Get(), cmd_lists.size(), cmd_lists.data());
 
-	// increment the fence value now, otherwise the buffer might not be uploaded by the time we start drawing
-	fence_values[frame_idx]++;
-	HRESULT hr = cmd_queue->Signal(fences[frame_idx].Get(), fence_values[frame_idx]);
-	if (FAILED(hr)) {
-		throw "Failed to signal command queue.";
-	}
+	// signal the fence now, otherwise the buffer might not be uploaded by the time we start drawing
+	auto upload_fence_value = fence->Signal(cmd_queue.Get());
+	direct_pool->Release(upload, fence->Get(), upload_fence_value);
 
 	// Initialize the scene
 	for (auto i = 0; i < NUM_RENDER_OBJECTS; i++)
 	{
 		draw_list[i].vb_view = vertex_buffer_view;
 		draw_list[i].ib_view = index_buffer_view;
-		CreateConstantBuffer(&draw_list[i].const_buffer, sizeof(CBPerObject));
 		draw_list[i].pos = { 0, 0, 0, 1 };
 		draw_list[i].color = { 1, 0, 0, 1};
+#ifdef MULTI_STATE_WORKLOAD
+		draw_list[i].pipeline = i % NUM_PIPELINES;
+		draw_list[i].mesh = (i / NUM_PIPELINES) % NUM_MESHES;
+		draw_list[i].vb_view = mesh_views[draw_list[i].mesh];
+#endif
+#ifdef CB_PARTITIONS
+		draw_list[i].material = i % NUM_MATERIALS;
+#endif
+#ifdef CB_DEDUP
+		draw_list[i].color.z = (float)(i % CB_DEDUP_DISTINCT_PAYLOADS) / CB_DEDUP_DISTINCT_PAYLOADS;
+#endif
+	}
+	draw_list_version++;
+
+#ifdef CB_PAYLOAD_QUANTIZED
+	// The scene doesn't move, the bounds it starts with hold for every frame.
+	DirectX::XMFLOAT3 min_pos = { draw_list[0].pos.x, draw_list[0].pos.y, draw_list[0].pos.z };
+	DirectX::XMFLOAT3 max_pos = min_pos;
+	for (auto const & obj : draw_list)
+	{
+		min_pos = { (std::min)(min_pos.x, obj.pos.x), (std::min)(min_pos.y, obj.pos.y), (std::min)(min_pos.z, obj.pos.z) };
+		max_pos = { (std::max)(max_pos.x, obj.pos.x), (std::max)(max_pos.y, obj.pos.y), (std::max)(max_pos.z, obj.pos.z) };
+	}
+	float extent = (std::max)({ max_pos.x - min_pos.x, max_pos.y - min_pos.y, max_pos.z - min_pos.z }) / 2 + CB_PAYLOAD_QUANTIZE_MARGIN;
+#ifdef PIPELINED_SIMULATION
+	extent += PIPELINED_SIMULATION_BOUNDS;
+#endif
+	payload_origin = { (min_pos.x + max_pos.x) / 2, (min_pos.y + max_pos.y) / 2, (min_pos.z + max_pos.z) / 2, extent };
+#endif
+
+	CreateFrameResources();
+
+#ifdef PIPELINED_SIMULATION
+	sim_objects.resize(NUM_RENDER_OBJECTS);
+	for (auto i = 0; i < NUM_RENDER_OBJECTS; i++)
+	{
+		// Spread the directions with the golden angle so neighbours don't move in lockstep.
+		float angle = i * 2.39996323f;
+		sim_objects[i].start = draw_list[i].pos;
+		sim_objects[i].pos = draw_list[i].pos;
+		sim_objects[i].velocity = { std::cos(angle) * PIPELINED_SIMULATION_SPEED, std::sin(angle) * PIPELINED_SIMULATION_SPEED, 0, 0 };
+	}
+
+	for (auto& snapshot : snapshots.GetBuffers())
+	{
+		snapshot.objects.resize(NUM_RENDER_OBJECTS);
+		CollectSnapshot(snapshot);
+	}
+	sim_prev_tick = profiler::Now();
+#ifdef PIPELINED_SIMULATION_SWEEP
+	prev_pipeline_frame = sim_prev_tick;
+#endif
+	sim_running = true;
+	sim_thread = std::thread(&BufferPerfApp::SimulationLoop, this);
+#endif
+
+	// Start counting the framerate.
+	prev = std::chrono::high_resolution_clock::now();
+}
+
+void BufferPerfApp::Update()
+{
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	// Go one deeper every few frames until every depth has been measured.
+	if (++sweep_frame % FRAMES_IN_FLIGHT_SWEEP_FRAMES == 0 && frames_in_flight < MAX_FRAMES_IN_FLIGHT)
+	{
+		SetFramesInFlight(frames_in_flight + 1);
+	}
+#endif
+
+#ifdef CB_DEFAULT_HEAP
+	BeginUploadFrame();
+#endif
+
+#ifdef FRAME_TASK_GRAPH
+	// The update runs as part of the frame graph.
+	return;
+#endif
+
+	// The GPU has to be done with this frame's constant buffers before they are overwritten.
+	WaitForPrevFrame();
+
+	PROFILER_BEGIN_CPU("update")
+#ifdef PIPELINED_SIMULATION
+	ConsumeSnapshot();
+#endif
+#ifdef CB_DEDUP
+	// The big buffer of this frame gets packed from its first slot again.
+	dedup->Clear();
+#endif
+#ifdef INSTANCE_BATCHING
+	// The per object data is written in batch order, so the draws are sorted first.
+	SortDraws();
+	BuildInstanceBatches();
+#elif defined PARALLEL_UPDATE
+	if (draw_list.size() < PARALLEL_UPDATE_MIN_OBJECTS)
+	{
+		UpdateRange(0, draw_list.size());
+	}
+	else
+	{
+#ifdef PARALLEL_UPDATE_SWEEP
+		// Cycle through every thread count so the scaling can be compared within a single run.
+		std::uint32_t num_threads = (update_sweep_frame++ % job_system.GetNumThreads()) + 1;
+		std::string sweep_name = "update_" + std::to_string(num_threads) + "_threads";
+		PROFILER_BEGIN_CPU(sweep_name)
+		ParallelUpdate(num_threads);
+		PROFILER_END_CPU(sweep_name)
+#else
+		ParallelUpdate(job_system.GetNumThreads());
+#endif // PARALLEL_UPDATE_SWEEP
+	}
+#else // PARALLEL_UPDATE
+	UpdateRange(0, draw_list.size());
+#endif // PARALLEL_UPDATE
+#ifdef CB_MAP_RANGE_TRACKING
+	map_tracker->UnmapAll();
+#endif
+	PROFILER_END_CPU("update")
+
+#ifdef CB_DEFAULT_HEAP
+	PROFILER_BEGIN_CPU("constant_upload")
+	FlushConstantUploads();
+	PROFILER_END_CPU("constant_upload")
+#endif
+
+#ifdef CB_PARTITIONS
+	PROFILER_BEGIN_CPU("frame_constants")
+	WriteFrameConstants();
+	PROFILER_END_CPU("frame_constants")
+
+	PROFILER_BEGIN_CPU("materials")
+	FlushMaterials();
+	PROFILER_END_CPU("materials")
+#endif
+}
+
+void BufferPerfApp::UpdateRange(std::size_t begin, std::size_t end)
+{
+#ifdef CB_PARTITIONS
+	std::uint64_t bytes_written = 0;
+#endif
+	for (auto i = begin; i < end; i++)
+	{
+		auto& obj = draw_list[i];
+
+		/* COLLECT DATA */
+#ifdef PIPELINED_SIMULATION
+		CBPerObject data = snapshots.GetReadBuffer().objects[i];
+#else
+		CBPerObject data;
+		data.pos = obj.pos;
+		data.color = obj.color;
+#endif
+
+#ifdef CB_DEFAULT_HEAP
+		// The scene is static, so the first objects are made to change every frame.
+		if (i < changed_objects)
+			data.color.y = (upload_frame & 1) ? 0.1f : 0.0f;
+#endif
+
+#ifdef CB_PAYLOAD_COMPACT
+		PackedPayload payload;
+		EncodePayload(data, payload);
+#else
+		auto const & payload = data;
+#endif
+
+#ifdef CB_DEFAULT_HEAP
+		if (read_default_heap)
+		{
+			// Only copied if it differs from what the slot holds.
+			constant_uploader->Write(obj.const_buffer->slot, &payload);
+			continue;
+		}
+#endif
+
+#ifdef CB_DEDUP
+		// Only the first object with this payload writes it, the others bind its slot.
+		bool found;
+		auto offset = (std::size_t)dedup->Insert(&payload, found) * ((sizeof(CBPerObject) + 255) & ~255);
+		obj.const_buffer->dedup_offset = offset;
+		if (found)
+			continue;
+#elif defined CB_BIG_BUFFER
+		auto offset = obj.const_buffer->offset;
+#endif
+
+		/* UPDATE CONSTANT BUFFERS */
+#ifdef CB_PARTITIONS
+		bytes_written += sizeof(payload);
+#endif
+#ifdef CB_MAP_RANGE_TRACKING
+#ifdef CB_BIG_BUFFER
+		map_tracker->Write(big_cb_buffers[frame_in_flight_idx].Get(), offset, &payload, sizeof(payload));
+#else
+		map_tracker->Write(obj.const_buffer->buffers[frame_in_flight_idx].Get(), 0, &payload, sizeof(payload));
+#endif
+#else // CB_MAP_RANGE_TRACKING
+#ifdef CB_MAP_ON_UPDATE
+		void* adress;
+		CD3DX12_RANGE readRange(0, 0);
+#ifdef CB_BIG_BUFFER
+		interposer::Map(big_cb_buffers[frame_in_flight_idx].Get(), 0, &readRange, &adress);
+#else // CB_BIG_BUFFER
+		interposer::Map(obj.const_buffer->buffers[frame_in_flight_idx].Get(), 0, &readRange, &adress);
+#endif // CB_BIG_BUFFER
+#endif
+
+#ifdef CB_MAP_ON_UPDATE
+#ifdef CB_BIG_BUFFER
+		std::memcpy((UINT8*)adress + offset, &payload, sizeof(payload));
+#else
+		std::memcpy(adress, &payload, sizeof(payload));
+#endif
+#endif // CB_MAP_ON_UPDATE
+#ifdef CB_MAP_ON_CREATION
+#ifdef CB_BIG_BUFFER
+		std::memcpy((UINT8*)big_cb_addresses[frame_in_flight_idx] + offset, &payload, sizeof(payload));
+#else // CB_BIG_BUFFER
+		std::memcpy(obj.const_buffer->addresses[frame_in_flight_idx], &payload, sizeof(payload));
+#endif // CB_BIG_BUFFER
+#endif // CB_MAP_ON_CREATION
+
+#if defined CB_MAP_ON_UPDATE && defined CB_UNMAP
+#ifdef CB_BIG_BUFFER
+		interposer::Unmap(big_cb_buffers[frame_in_flight_idx].Get(), 0, &readRange);
+#else // CB_BIG_BUFFER
+		interposer::Unmap(obj.const_buffer->buffers[frame_in_flight_idx].Get(), 0, &readRange);
+#endif // CB_BIG_BUFFER
+#endif // CB_MAP_ON_UPDATE && CB_UNMAP
+#endif // CB_MAP_RANGE_TRACKING
+	}
+#ifdef CB_PARTITIONS
+	object_bytes += bytes_written;
+#endif
+}
+
+#ifdef PARALLEL_UPDATE
+void BufferPerfApp::ParallelUpdate(std::uint32_t num_threads)
+{
+	// Don't hand out chunks that are too small to be worth the synchronization.
+	std::size_t num_groups = (draw_list.size() + granularity - 1) / granularity;
+	std::size_t min_groups_per_chunk = (PARALLEL_UPDATE_MIN_OBJECTS_PER_CHUNK + granularity - 1) / granularity;
+	std::size_t max_chunks = num_groups / min_groups_per_chunk;
+	std::uint32_t num_chunks = static_cast<std::uint32_t>(max_chunks < num_threads ? max_chunks : num_threads);
+
+	if (num_chunks <= 1)
+	{
+		UpdateRange(0, draw_list.size());
+		return;
+	}
+
+	job_system.ParallelFor(num_groups, num_chunks, [this](std::size_t begin, std::size_t end, std::uint32_t)
+	{
+		std::size_t obj_end = end * granularity;
+		UpdateRange(begin * granularity, obj_end < draw_list.size() ? obj_end : draw_list.size());
+	});
+}
+#endif // PARALLEL_UPDATE
+
+void BufferPerfApp::Render()
+{
+#ifdef FRAME_TASK_GRAPH
+	RunFrameGraph();
+#else // FRAME_TASK_GRAPH
+	UpdateFramerate();
+
+#if defined DRAW_SORTING && !defined INSTANCE_BATCHING
+	PROFILER_BEGIN_CPU("draw_sort");
+	SortDraws();
+	PROFILER_END_CPU("draw_sort");
+#endif
+
+#ifdef MT_RECORDING
+	RecordPrePass()->Close();
+
+	// Every worker records a contiguous range of the draw list.
+	PROFILER_BEGIN_CPU("drawing");
+	job_system.ParallelFor(draw_list.size(), NUM_RECORD_THREADS, [this](std::size_t begin, std::size_t end, std::uint32_t chunk_idx)
+	{
+		RecordWorkerChunk(chunk_idx, begin, end);
+	});
+	PROFILER_END_CPU("drawing");
+#else // MT_RECORDING
+	auto list = RecordPrePass();
+
+#ifdef CB_BUNDLES
+	// Only re-record when the scene changed since this frame's bundle was recorded.
+	if (bundle_versions[frame_in_flight_idx] != draw_list_version)
+	{
+		PROFILER_BEGIN_CPU("bundle_record");
+		RecordBundle();
+		PROFILER_END_CPU("bundle_record");
+	}
+
+	PROFILER_BEGIN_CPU("drawing");
+	// Bundles inherit neither the viewport nor the scissor, the root signature has to match the bundle's.
+	list->SetGraphicsRootSignature(root_signature.Get());
+	list->RSSetViewports(1, &viewport);
+	list->RSSetScissorRects(1, &scissor_rect);
+	list->ExecuteBundle(bundles[frame_in_flight_idx]->list.Get());
+	PROFILER_END_CPU("drawing");
+	frame_lists[0]->num_commands = 1;
+#elif defined INSTANCE_BATCHING
+	PROFILER_BEGIN_CPU("drawing");
+	RecordDrawState(list);
+	RecordInstanceBatches(list);
+	PROFILER_END_CPU("drawing");
+#ifdef CB_ARRAY
+	frame_lists[0]->num_commands = draw_list.size();
+#else
+	frame_lists[0]->num_commands = instance_batcher->GetBatches().size();
+#endif
+#elif defined SPLIT_SUBMISSION
+	PROFILER_BEGIN_CPU("drawing");
+	list = RecordSplitSubmission(list);
+	PROFILER_END_CPU("drawing");
+#else
+	PROFILER_BEGIN_CPU("drawing");
+	RecordDrawRange(list, 0, draw_list.size());
+	PROFILER_END_CPU("drawing");
+	frame_lists[0]->num_commands = draw_list.size();
+#endif // CB_BUNDLES
+
+	RecordEndTransition(list);
+	list->Close();
+#endif // MT_RECORDING
+	// ### STOPPED RECORDING ###
+
+	SubmitFrame();
+#endif // FRAME_TASK_GRAPH
+}
+
+#ifdef FRAME_TASK_GRAPH
+void BufferPerfApp::RunFrameGraph()
+{
+	frame_graph.Clear();
+
+	// wait -> update[i] -> cull[i] -> record[i] -> submit
+	//      -> pre pass ------------------------^
+	auto wait = frame_graph.Add("task_wait", [this]
+	{
+		WaitForPrevFrame();
+		UpdateFramerate();
+	});
+
+	auto pre_pass = frame_graph.Add("task_pre_pass", [this]
+	{
+		RecordPrePass()->Close();
+	});
+	frame_graph.AddDependency(wait, pre_pass);
+
+	auto submit = frame_graph.Add("task_submit", [this] { SubmitFrame(); });
+	frame_graph.AddDependency(pre_pass, submit);
+
+#ifdef CB_MAP_RANGE_TRACKING
+	// Unmaps once every update wrote its ranges.
+	auto unmap = frame_graph.Add("task_unmap", [this] { map_tracker->UnmapAll(); });
+	frame_graph.AddDependency(unmap, submit);
+#endif
+
+#ifdef CB_DEFAULT_HEAP
+	// Only what is submitted after the flush waits for the copies.
+	auto upload = frame_graph.Add("task_upload", [this] { FlushConstantUploads(); });
+	frame_graph.AddDependency(upload, submit);
+#endif
+
+#ifdef CB_PARTITIONS
+	auto frame_constants = frame_graph.Add("task_frame_constants", [this] { WriteFrameConstants(); });
+	frame_graph.AddDependency(wait, frame_constants);
+	frame_graph.AddDependency(frame_constants, submit);
+	// Both count the frames, so they run one after the other.
+	auto material_upload = frame_graph.Add("task_materials", [this] { FlushMaterials(); });
+	frame_graph.AddDependency(frame_constants, material_upload);
+	frame_graph.AddDependency(material_upload, submit);
+#endif
+
+#ifdef DRAW_SORTING
+	// The sort only reads state the update and cull tasks don't write.
+	auto sort = frame_graph.Add("task_sort", [this] { SortDraws(); });
+	frame_graph.AddDependency(wait, sort);
+	std::array<Task*, NUM_RECORD_THREADS> culls;
+	std::array<Task*, NUM_RECORD_THREADS> records;
+#endif
+
+	// Chunk boundaries are cache line aligned since the update and cull tasks write to the scene.
+	std::size_t num_groups = (draw_list.size() + granularity - 1) / granularity;
+	for (std::uint32_t i = 0; i < NUM_RECORD_THREADS; i++)
+	{
+		std::size_t begin = (std::min)(num_groups * i / NUM_RECORD_THREADS * granularity, draw_list.size());
+		std::size_t end = (std::min)(num_groups * (i + 1) / NUM_RECORD_THREADS * granularity, draw_list.size());
+
+		auto update = frame_graph.Add("task_update", [this, begin, end] { UpdateRange(begin, end); });
+		auto cull = frame_graph.Add("task_cull", [this, begin, end] { CullRange(begin, end); });
+		auto record = frame_graph.Add("task_record", [this, i, begin, end] { RecordWorkerChunk(i, begin, end); });
+
+		frame_graph.AddDependency(wait, update);
+		frame_graph.AddDependency(update, cull);
+#ifdef CB_DEFAULT_HEAP
+		frame_graph.AddDependency(update, upload);
+#endif
+#ifdef CB_MAP_RANGE_TRACKING
+		frame_graph.AddDependency(update, unmap);
+#endif
+		frame_graph.AddDependency(pre_pass, record);
+		frame_graph.AddDependency(record, submit);
+#ifdef DRAW_SORTING
+		frame_graph.AddDependency(sort, record);
+		culls[i] = cull;
+		records[i] = record;
+#else
+		frame_graph.AddDependency(cull, record);
+#endif
+	}
+
+#ifdef DRAW_SORTING
+	// A sorted record range can contain objects of every cull range.
+	for (auto cull : culls)
+	{
+		for (auto record : records)
+			frame_graph.AddDependency(cull, record);
+	}
+#endif
+
+	job_system.Run(frame_graph);
+	frame_graph.ReportToProfiler();
+}
+
+void BufferPerfApp::CullRange(std::size_t begin, std::size_t end)
+{
+	// The quads are 1 unit wide, test their center against the clip space bounds grown by half of that.
+	for (auto i = begin; i < end; i++)
+	{
+		auto& obj = draw_list[i];
+		obj.visible = obj.pos.x >= -1.5f && obj.pos.x <= 1.5f && obj.pos.y >= -1.5f && obj.pos.y <= 1.5f;
+	}
+}
+#endif // FRAME_TASK_GRAPH
+
+CommandRecorder* BufferPerfApp::RecordPrePass()
+{
+	frame_lists[0] = direct_pool->Acquire(pipeline.Get());
+	auto cmd_list = &frame_lists[0]->recorder;
+
+	// ### BEGIN RECORDING ###
+	auto begin_transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		render_targets[frame_idx].Get(),
+		D3D12_RESOURCE_STATE_PRESENT,
+		D3D12_RESOURCE_STATE_RENDER_TARGET);
+	cmd_list->ResourceBarrier(1, &begin_transition);
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(render_target_view_heap->GetCPUDescriptorHandleForHeapStart(), frame_idx, rtv_increment_size);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(depth_stencil_view_heap->GetCPUDescriptorHandleForHeapStart());
+	cmd_list->OMSetRenderTargets(1, &rtv_handle, false, &dsv_handle);
+	cmd_list->ClearRenderTargetView(rtv_handle, clear_color, 0, nullptr);
+	cmd_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+	return cmd_list;
+}
+
+void BufferPerfApp::RecordEndTransition(CommandRecorder* list)
+{
+	auto end_transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		render_targets[frame_idx].Get(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PRESENT
+	);
+	list->ResourceBarrier(1, &end_transition);
+}
+
+#ifdef MT_RECORDING
+void BufferPerfApp::RecordWorkerChunk(std::uint32_t chunk_idx, std::size_t begin, std::size_t end)
+{
+	// Every worker gets its own pair from the pool, big ones are preferred since they won't have to grow.
+	auto entry = direct_pool->Acquire(pipeline.Get(), true);
+	frame_lists[chunk_idx + 1] = entry;
+	entry->num_commands = end - begin;
+	auto list = &entry->recorder;
+
+	BindRenderTargets(list);
+	RecordDrawRange(list, begin, end);
+
+	// The last list transitions the render target back.
+	if (chunk_idx == NUM_RECORD_THREADS - 1)
+	{
+		RecordEndTransition(list);
+	}
+
+	list->Close();
+}
+#endif // MT_RECORDING
+
+#ifdef SPLIT_SUBMISSION
+CommandRecorder* BufferPerfApp::RecordSplitSubmission(CommandRecorder* list)
+{
+	auto record_start = profiler::Now();
+	profiler::TimePoint first_submit;
+
+	// The pre pass list is the first chunk so the begin transition comes before every draw.
+	split_lists.clear();
+	split_lists.push_back(frame_lists[0]);
+	RecordDrawState(list);
+
+	std::size_t begin = 0;
+	while (true)
+	{
+		std::size_t end = (std::min)(begin + split_draws, draw_list.size());
+		RecordObjectDraws(list, begin, end);
+		split_lists.back()->num_commands = end - begin;
+		begin = end;
+
+		// The last chunk gets the end transition and is submitted by SubmitFrame together with the fence signal.
+		if (begin == draw_list.size())
+			break;
+
+		list->Close();
+		std::array<ID3D12CommandList*, 1> cmd_lists = { list->Get() };
+		interposer::ExecuteCommandLists(cmd_queue.Get(), cmd_lists.size(), cmd_lists.data());
+		if (split_lists.size() == 1)
+			first_submit = profiler::Now();
+
+		// State doesn't carry over between command lists.
+		auto entry = direct_pool->Acquire(pipeline.Get(), true);
+		split_lists.push_back(entry);
+		list = &entry->recorder;
+		BindRenderTargets(list);
+		RecordDrawState(list);
+	}
+
+	auto record_end = profiler::Now();
+
+	// Adapt the chunk size to the measured record rate so a chunk takes roughly the target time to record.
+	auto record_us = profiler::Duration(record_end - record_start).count() * 1000;
+	if (record_us > 0)
+	{
+		auto draws_per_us = draw_list.size() / record_us;
+		auto target_draws = (std::size_t)(draws_per_us * SPLIT_SUBMISSION_TARGET_US);
+		split_draws = (split_draws * 3 + target_draws) / 4;
+		split_draws = (std::max)(split_draws, (std::size_t)SPLIT_SUBMISSION_MIN_DRAWS);
 	}
 
-	// Start counting the framerate.
-	prev = std::chrono::high_resolution_clock::now();
+	// How much earlier the GPU received work compared to submitting everything at the end.
+	split_chunks += split_lists.size();
+	if (split_lists.size() > 1)
+		split_lead_sum += profiler::Duration(record_end - first_submit).count();
+	split_frames++;
+
+	return list;
+}
+
+void BufferPerfApp::PerfOutput_SplitSubmission()
+{
+	std::ofstream file;
+	file.open("perf_split_submission.txt");
+
+	file << "Split submission over " << split_frames << " frames:\n";
+	file << "\tTarget chunk time: " << SPLIT_SUBMISSION_TARGET_US << "us\n";
+	file << "\tFinal draws per chunk: " << split_draws << '\n';
+	file << "\tAverage chunks per frame: " << (long double)split_chunks / split_frames << '\n';
+	file << "\tAverage time the first chunk was submitted before recording finished: " << split_lead_sum / split_frames << "ms\n";
+
+	file.close();
+}
+#endif // SPLIT_SUBMISSION
+
+void BufferPerfApp::SubmitFrame()
+{
+#ifdef SPLIT_SUBMISSION
+	// Every chunk but the last one is already submitted.
+	std::array<ID3D12CommandList*, 1> cmd_lists = { split_lists.back()->list.Get() };
+	interposer::ExecuteCommandLists(cmd_queue.Get(), cmd_lists.size(), cmd_lists.data());
+
+	frame_fence_values[frame_in_flight_idx] = fence->Signal(cmd_queue.Get());
+
+	for (auto entry : split_lists)
+		direct_pool->Release(entry, fence->Get(), frame_fence_values[frame_in_flight_idx]);
+	split_lists.clear();
+#else // SPLIT_SUBMISSION
+	// Submit in draw order with a single call.
+	std::array<ID3D12CommandList*, std::tuple_size<decltype(frame_lists)>::value> cmd_lists;
+	for (auto i = 0; i < frame_lists.size(); i++)
+		cmd_lists[i] = frame_lists[i]->list.Get();
+	interposer::ExecuteCommandLists(cmd_queue.Get(), cmd_lists.size(), cmd_lists.data());
+
+	// GPU Signal, the lists can be reused as soon as the GPU passed this value.
+	frame_fence_values[frame_in_flight_idx] = fence->Signal(cmd_queue.Get());
+	for (auto entry : frame_lists)
+		direct_pool->Release(entry, fence->Get(), frame_fence_values[frame_in_flight_idx]);
+#ifdef INSTANCE_BATCHING
+	instance_batcher->End(frame_fence_values[frame_in_flight_idx]);
+#endif
+#endif // SPLIT_SUBMISSION
+
+#if defined CB_DEFAULT_HEAP || defined CB_PARTITIONS
+	upload_read_values[frame_in_flight_idx] = frame_fence_values[frame_in_flight_idx];
+#endif
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	frame_submitted[frame_in_flight_idx] = true;
+#endif
+	frame_in_flight_idx = (frame_in_flight_idx + 1) % frames_in_flight;
+}
+
+void BufferPerfApp::BindRenderTargets(CommandRecorder* list)
+{
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(render_target_view_heap->GetCPUDescriptorHandleForHeapStart(), frame_idx, rtv_increment_size);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(depth_stencil_view_heap->GetCPUDescriptorHandleForHeapStart());
+	list->OMSetRenderTargets(1, &rtv_handle, false, &dsv_handle);
+}
+
+void BufferPerfApp::RecordDrawRange(CommandRecorder* list, std::size_t begin, std::size_t end)
+{
+	RecordDrawState(list);
+	RecordObjectDraws(list, begin, end);
+}
+
+void BufferPerfApp::RecordDrawState(CommandRecorder* list)
+{
+	// Every list is acquired with the pipeline already bound.
+	list->SetGraphicsRootSignature(root_signature.Get());
+
+	list->RSSetViewports(1, &viewport);
+	list->RSSetScissorRects(1, &scissor_rect);
+
+	RecordSharedDrawState(list);
+}
+
+void BufferPerfApp::RecordSharedDrawState(CommandRecorder* list)
+{
+	list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+#ifdef VERTEX_PULLING
+	// There is no input assembler, the shader loads the vertices itself.
+	list->SetGraphicsRootShaderResourceView(1, vertex_buffer_view.BufferLocation);
+#else
+	list->IASetVertexBuffers(0, 1, &vertex_buffer_view);
+#endif
+#ifdef CB_PAYLOAD_QUANTIZED
+	std::array<UINT, 4> origin;
+	std::memcpy(origin.data(), &payload_origin, sizeof(origin));
+	for (UINT i = 0; i < origin.size(); i++)
+		list->SetGraphicsRoot32BitConstant(payload_origin_parameter, origin[i], i);
+#endif
+#ifdef CB_PARTITIONS
+	// Bundles are recorded per frame in flight, so they can bind their frame's slot as well.
+	list->SetGraphicsRootConstantBufferView(1, frame_cb_gpu_address + (std::uint64_t)frame_in_flight_idx * ((sizeof(CBPerFrame) + 255) & ~255));
+#endif
+}
+
+void BufferPerfApp::RecordObjectDraws(CommandRecorder* list, std::size_t begin, std::size_t end)
+{
+#ifdef MULTI_STATE_WORKLOAD
+	// Only switch when the object needs different state, grouping the draws is what saves the switches.
+	std::uint32_t bound_pipeline = ~0u;
+	std::uint32_t bound_mesh = ~0u;
+#endif
+#ifdef CB_PARTITIONS
+	std::uint32_t bound_material = ~0u;
+	std::uint64_t num_material_binds = 0;
+#endif
+
+	for (auto i = begin; i < end; i++)
+	{
+#ifdef DRAW_SORTING
+		auto& obj = draw_list[draw_queue.GetDraws()[i].idx];
+#else
+		auto& obj = draw_list[i];
+#endif
+#ifdef FRAME_TASK_GRAPH
+		if (!obj.visible)
+			continue;
+#endif
+#ifdef MULTI_STATE_WORKLOAD
+		if (obj.pipeline != bound_pipeline)
+		{
+			list->SetPipelineState(pipelines[obj.pipeline].Get());
+			bound_pipeline = obj.pipeline;
+		}
+		if (obj.mesh != bound_mesh)
+		{
+			list->IASetVertexBuffers(0, 1, &obj.vb_view);
+			bound_mesh = obj.mesh;
+		}
+#endif
+#ifdef CB_GPU_ADDRESS_PER_FRAME
+#ifdef CB_BIG_BUFFER
+		auto address = interposer::GetGPUVirtualAddress(big_cb_buffers[frame_in_flight_idx].Get()) + obj.const_buffer->offset;
+#else
+		auto address = interposer::GetGPUVirtualAddress(obj.const_buffer->buffers[frame_in_flight_idx].Get());
+#endif
+#else
+		auto address = obj.const_buffer->gpu_addresses[frame_in_flight_idx];
+#endif
+#ifdef CB_DEFAULT_HEAP
+		if (read_default_heap)
+		{
+#ifdef CB_GPU_ADDRESS_PER_FRAME
+			address = interposer::GetGPUVirtualAddress(constant_uploader->GetBuffer(frame_in_flight_idx)) + obj.const_buffer->offset;
+#else
+			address = obj.const_buffer->default_heap_addresses[frame_in_flight_idx];
+#endif
+		}
+#endif
+#ifdef CB_DEDUP
+		address += obj.const_buffer->dedup_offset - obj.const_buffer->offset;
+#endif
+		list->SetGraphicsRootConstantBufferView(0, address);
+#ifdef CB_PARTITIONS
+		if (obj.material != bound_material)
+		{
+			list->SetGraphicsRootConstantBufferView(2, material_uploader->GetSlotAddress(frame_in_flight_idx, obj.material));
+			bound_material = obj.material;
+			num_material_binds++;
+		}
+#endif
+		//list->DrawIndexedInstanced(indices.size(), 1, 0, 0, 0);
+		list->DrawInstanced(vertices.size(), 1, 0, 0);
+	}
+#ifdef CB_PARTITIONS
+	material_binds += num_material_binds;
+#endif
+}
+
+#ifdef DRAW_SORTING
+void BufferPerfApp::SortDraws()
+{
+	draw_queue.Clear();
+	for (std::uint32_t i = 0; i < draw_list.size(); i++)
+	{
+		auto const & obj = draw_list[i];
+		// Without partitions there are no materials, every object only has its own constant data.
+		draw_queue.Push(DrawQueue::MakeKey(obj.pipeline, 0, obj.mesh, obj.material, obj.pos.z), i);
+	}
+	draw_queue.Sort();
+}
+#endif // DRAW_SORTING
+
+#ifdef INSTANCE_BATCHING
+void BufferPerfApp::BuildInstanceBatches()
+{
+	for (auto const & draw : draw_queue.GetDraws())
+	{
+		auto data = static_cast<CBPerObject*>(instance_batcher->Add(draw.key & DrawQueue::state_mask, draw.idx));
+#ifdef PIPELINED_SIMULATION
+		*data = snapshots.GetReadBuffer().objects[draw.idx];
+#else
+		auto const & obj = draw_list[draw.idx];
+		data->pos = obj.pos;
+		data->color = obj.color;
+#endif
+	}
+
+	instanced_batches += instance_batcher->GetBatches().size();
+	instanced_frames++;
+
+#ifdef RESIDENCY_MANAGEMENT
+	// Pages past the ones marked before the budget was enforced were created this frame or taken from further back.
+	for (; tracked_instance_pages < instance_batcher->GetNumPagesCreated(); tracked_instance_pages++)
+		TrackResidency(instance_batcher->GetPage(tracked_instance_pages));
+	for (auto page : instance_batcher->GetFramePages())
+		residency->MarkUsed(page, fence->GetNextValue());
+	residency->MakeUsedResident();
+#endif
+}
+
+void BufferPerfApp::RecordInstanceBatches(CommandRecorder* list)
+{
+	std::uint32_t bound_page = ~0u;
+#ifdef MULTI_STATE_WORKLOAD
+	std::uint32_t bound_pipeline = ~0u;
+	std::uint32_t bound_mesh = ~0u;
+#endif
+
+	for (auto const & batch : instance_batcher->GetBatches())
+	{
+#ifdef MULTI_STATE_WORKLOAD
+		// Every instance of a batch shares the state of its first object.
+		auto const & obj = draw_list[batch.object];
+		if (obj.pipeline != bound_pipeline)
+		{
+			list->SetPipelineState(pipelines[obj.pipeline].Get());
+			bound_pipeline = obj.pipeline;
+		}
+		if (obj.mesh != bound_mesh)
+		{
+#ifdef VERTEX_PULLING
+			list->SetGraphicsRootShaderResourceView(1, obj.vb_view.BufferLocation);
+#else
+			list->IASetVertexBuffers(0, 1, &obj.vb_view);
+#endif
+			bound_mesh = obj.mesh;
+		}
+#endif
+#if defined INSTANCING || defined VERTEX_PULLING
+		if (batch.page != bound_page)
+		{
+			list->SetGraphicsRootShaderResourceView(instance_page_parameter, instance_batcher->GetPageAddress(batch.page));
+			bound_page = batch.page;
+		}
+		list->SetGraphicsRoot32BitConstant(0, batch.first, 0);
+		list->DrawInstanced(vertices.size(), batch.count, 0, 0);
+#elif defined CB_ARRAY
+		if (batch.page != bound_page)
+		{
+			list->SetGraphicsRootConstantBufferView(instance_page_parameter, instance_batcher->GetPageAddress(batch.page));
+			bound_page = batch.page;
+		}
+		// Still one draw per object, only the index changes between them.
+		for (std::uint32_t i = 0; i < batch.count; i++)
+		{
+			list->SetGraphicsRoot32BitConstant(0, batch.first + i, 0);
+			list->DrawInstanced(vertices.size(), 1, 0, 0);
+		}
+#else // INSTANCE_VERTEX_BUFFER
+		if (batch.page != bound_page)
+		{
+			D3D12_VERTEX_BUFFER_VIEW instance_view;
+			instance_view.BufferLocation = instance_batcher->GetPageAddress(batch.page);
+			instance_view.StrideInBytes = sizeof(CBPerObject);
+			instance_view.SizeInBytes = INSTANCE_PAGE_SIZE;
+			list->IASetVertexBuffers(1, 1, &instance_view);
+			bound_page = batch.page;
+		}
+		// Unlike SV_InstanceID, per instance vertex data does take the start instance into account.
+		list->DrawInstanced(vertices.size(), batch.count, 0, batch.first);
+#endif // INSTANCE_VERTEX_BUFFER
+	}
+}
+
+void BufferPerfApp::PerfOutput_Instancing()
+{
+	std::ofstream file;
+	file.open("perf_instancing.txt");
+
+	file << "Instancing over " << instanced_frames << " frames:\n";
+	file << "\tObjects: " << NUM_RENDER_OBJECTS << '\n';
+	file << "\tAverage draws per frame: " << (long double)instanced_batches / instanced_frames << '\n';
+	file << "\tInstances per page: " << instance_batcher->GetInstancesPerPage() << '\n';
+	file << "\tPages created: " << instance_batcher->GetNumPagesCreated() << '\n';
+
+	file.close();
+}
+#endif // INSTANCE_BATCHING
+
+#ifdef CB_BUNDLES
+void BufferPerfApp::RecordBundle()
+{
+	// The old bundle might still be referenced by frames in flight.
+	if (bundles[frame_in_flight_idx])
+	{
+		bundle_pool->Release(bundles[frame_in_flight_idx], fence->Get(), fence->GetNextValue());
+	}
+
+	auto entry = bundle_pool->Acquire(pipeline.Get());
+	auto bundle = &entry->recorder;
+
+	// Everything the draws need besides the viewport and scissor, instead of relying on what the executing list bound.
+	bundle->SetGraphicsRootSignature(root_signature.Get());
+	RecordSharedDrawState(bundle);
+	RecordObjectDraws(bundle, 0, draw_list.size());
+	bundle->Close();
+
+	entry->num_commands = draw_list.size();
+	bundles[frame_in_flight_idx] = entry;
+	bundle_versions[frame_in_flight_idx] = draw_list_version;
+}
+#endif // CB_BUNDLES
+
+#ifdef CB_DEFAULT_HEAP
+BufferPerfApp::UploadTotals& BufferPerfApp::GetUploadTotals()
+{
+#ifdef CB_DEFAULT_HEAP_SWEEP
+	return upload_sweep[upload_sweep_config / 2][upload_sweep_config % 2];
+#else
+	return upload_totals;
+#endif
+}
+
+void BufferPerfApp::BeginUploadFrame()
+{
+	auto now = profiler::Now();
+
+	// The first frames after a switch still wait for frames queued with the previous configuration.
+	if (++upload_config_frames > MAX_FRAMES_IN_FLIGHT)
+	{
+		auto& totals = GetUploadTotals();
+		totals.frames++;
+		totals.frame_time_sum += profiler::Duration(now - prev_upload_frame).count();
+	}
+	prev_upload_frame = now;
+	upload_frame++;
+
+#ifdef CB_DEFAULT_HEAP_SWEEP
+	// Every step is measured reading the upload heap first and the default heap second.
+	if (upload_config_frames >= CB_DEFAULT_HEAP_SWEEP_FRAMES && upload_sweep_config + 1 < upload_sweep.size() * 2)
+	{
+		upload_sweep_config++;
+		upload_config_frames = 0;
+		read_default_heap = upload_sweep_config % 2;
+		changed_objects = NUM_RENDER_OBJECTS * (upload_sweep_config / 2) * CB_DEFAULT_HEAP_SWEEP_STEP_PERCENT / 100;
+		// The recorded addresses change with the heap.
+		draw_list_version++;
+	}
+#endif
+}
+
+void BufferPerfApp::FlushConstantUploads()
+{
+	if (!read_default_heap)
+		return;
+
+	// Only the last frame that read this frame's copy has to be done, the ones after it read the other copies.
+	constant_uploader->Flush(frame_in_flight_idx, cmd_queue.Get(), fence->Get(), upload_read_values[frame_in_flight_idx]);
+
+	auto const & stats = constant_uploader->GetLastFlushStats();
+#ifdef CB_PARTITIONS
+	// The draws read the default heap, what reaches the GPU is what was staged.
+	object_bytes += stats.bytes;
+#endif
+	auto& totals = GetUploadTotals();
+	totals.flushes++;
+	totals.uploads.slots += stats.slots;
+	totals.uploads.commands += stats.commands;
+	totals.uploads.bytes += stats.bytes;
+}
+
+void BufferPerfApp::PerfOutput_ConstantUploads()
+{
+	std::ofstream file;
+	file.open("perf_default_heap.txt");
+
+	auto print = [&file](UploadTotals const & totals)
+	{
+		file << totals.frame_time_sum / totals.frames << "ms per frame";
+		if (totals.flushes > 0)
+		{
+			file << ", " << (long double)totals.uploads.slots / totals.flushes << " slots in "
+#ifdef CB_DELTA_SCATTER
+				<< (long double)totals.uploads.commands / totals.flushes << " dispatches, "
+#else
+				<< (long double)totals.uploads.commands / totals.flushes << " copies, "
+#endif
+				<< (long double)totals.uploads.bytes / totals.flushes << " bytes";
+		}
+		file << '\n';
+	};
+
+	file << "Default heap constants over " << NUM_RENDER_OBJECTS << " objects:\n";
+#ifdef CB_DEFAULT_HEAP_SWEEP
+	int crossover = -1;
+	for (std::size_t i = 0; i < upload_sweep.size(); i++)
+	{
+		auto const & upload_heap = upload_sweep[i][0];
+		auto const & default_heap = upload_sweep[i][1];
+		if (upload_heap.frames == 0 || default_heap.frames == 0)
+			continue;
+
+		int percent = static_cast<int>(i) * CB_DEFAULT_HEAP_SWEEP_STEP_PERCENT;
+		file << '\t' << percent << "% changed per frame:\n";
+		file << "\t\tUpload heap: ";
+		print(upload_heap);
+		file << "\t\tDefault heap: ";
+		print(default_heap);
+
+		if (crossover < 0 && default_heap.frame_time_sum / default_heap.frames >= upload_heap.frame_time_sum / upload_heap.frames)
+			crossover = percent;
+	}
+
+	if (crossover < 0)
+		file << "\tThe default heap was faster at every measured share of changed objects.\n";
+	else
+		file << "\tThe upload heap is as fast from " << crossover << "% changed objects per frame.\n";
+#else
+	file << '\t' << CB_DEFAULT_HEAP_CHANGED_PERCENT << "% changed per frame: ";
+	print(upload_totals);
+#endif
+	file << "\tWaits for space in the upload ring: " << constant_uploader->GetFence().GetStalls().size() << '\n';
+#ifdef CB_DELTA_SCATTER_VERIFY
+#ifdef RESIDENCY_MANAGEMENT
+	// The verification reads every copy, including the ones the budget evicted.
+	for (std::uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		residency->MarkUsed(constant_uploader->GetBuffer(i), fence->GetNextValue());
+	residency->MakeUsedResident();
+#endif
+	file << "\tSlots that differ from the CPU reference scatter: " << constant_uploader->Verify() << '\n';
+#endif
+
+	file.close();
+}
+#endif // CB_DEFAULT_HEAP
+
+#ifdef CB_PARTITIONS
+void BufferPerfApp::CreateFrameConstantBuffer()
+{
+	std::uint32_t slot_size = (sizeof(CBPerFrame) + 255) & ~255;
+
+	if (frame_cb_buffer)
+	{
+#ifdef RESIDENCY_MANAGEMENT
+		residency->Untrack(frame_cb_buffer.Get());
+#endif
+		auto allocated = memory::GetAllocatedSize(device.Get(), frame_cb_buffer.Get());
+		auto size = frame_cb_buffer->GetDesc().Width;
+		release_queue->Retire([allocated, size] { memory::Free(memory::Category::ConstantData, size, allocated); }, fence->GetLastSignaledValue());
+		release_queue->Retire(frame_cb_buffer, fence->GetLastSignaledValue());
+	}
+
+	std::uint64_t size = (std::uint64_t)slot_size * frames_in_flight;
+	HRESULT hr = interposer::CreateCommittedResource(
+		device.Get(),
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&frame_cb_buffer));
+	if (FAILED(hr))
+	{
+		throw "Failed to create per frame constant buffer";
+	}
+	frame_cb_buffer->SetName(L"Per Frame Constant Buffer");
+	memory::Allocate(memory::Category::ConstantData, size, memory::GetAllocatedSize(device.Get(), frame_cb_buffer.Get()));
+#ifdef RESIDENCY_MANAGEMENT
+	TrackResidency(frame_cb_buffer.Get());
+#endif
+
+	CD3DX12_RANGE read_range(0, 0);
+	hr = interposer::Map(frame_cb_buffer.Get(), 0, &read_range, reinterpret_cast<void**>(&frame_cb_address));
+	if (FAILED(hr))
+	{
+		throw "Failed to map per frame constant buffer";
+	}
+	frame_cb_gpu_address = frame_cb_buffer->GetGPUVirtualAddress();
+}
+
+void BufferPerfApp::WriteFrameConstants()
+{
+	// A slow pulse, so the data actually differs from frame to frame.
+	CBPerFrame data;
+	data.tint = { 0, 0, (partition_frames++ % 64) / 640.0f, 0 };
+
+	std::uint32_t slot_size = (sizeof(CBPerFrame) + 255) & ~255;
+	std::memcpy(frame_cb_address + (std::size_t)frame_in_flight_idx * slot_size, &data, sizeof(data));
+}
+
+void BufferPerfApp::FlushMaterials()
+{
+	if (partition_frames % CB_PARTITIONS_MATERIAL_CHANGE_FRAMES == 0)
+	{
+		auto idx = (partition_frames / CB_PARTITIONS_MATERIAL_CHANGE_FRAMES) % NUM_MATERIALS;
+		materials[idx].color.x = materials[idx].color.x == 1 ? 0.5f : 1.0f;
+		material_uploader->Write(static_cast<std::uint32_t>(idx), &materials[idx]);
+	}
+
+	// Only the last frame that read this frame's copy of the materials has to be done.
+	material_uploader->Flush(frame_in_flight_idx, cmd_queue.Get(), fence->Get(), upload_read_values[frame_in_flight_idx]);
+
+	auto const & stats = material_uploader->GetLastFlushStats();
+	material_uploads.slots += stats.slots;
+	material_uploads.commands += stats.commands;
+	material_uploads.bytes += stats.bytes;
+}
+
+void BufferPerfApp::PerfOutput_Partitions()
+{
+	std::ofstream file;
+	file.open("perf_partitions.txt");
+
+#ifdef FRAME_TASK_GRAPH
+	// The per object update is split into one task per record thread.
+	std::array<char const *, 3> names = { "task_frame_constants", "task_materials", "task_update" };
+#else
+	std::array<char const *, 3> names = { "frame_constants", "materials", "update" };
+#endif
+	long double frames = (std::max)(partition_frames, std::uint64_t(1));
+
+	file << "Constants partitioned by update frequency over " << NUM_RENDER_OBJECTS << " objects and " << NUM_MATERIALS << " materials:\n";
+	file << "\tPer frame: " << sizeof(CBPerFrame) << " bytes written per frame in "
+		<< profiler::GetAverage(names[0]) << "ms\n";
+	file << "\tPer material: " << material_uploads.bytes / frames << " bytes uploaded per frame in "
+		<< profiler::GetAverage(names[1]) << "ms, " << material_uploads.slots << " materials in " << material_uploads.commands << " copies overall, "
+		<< material_binds / frames << " binds recorded per frame\n";
+	file << "\tPer object: " << object_bytes / frames << " bytes written per frame in "
+		<< profiler::GetAverage(names[2]) << "ms\n";
+	file << "\tWaits for space in the material upload ring: " << material_uploader->GetFence().GetStalls().size() << '\n';
+
+	file.close();
+}
+#endif // CB_PARTITIONS
+
+#ifdef CB_DEDUP
+void BufferPerfApp::PerfOutput_Dedup()
+{
+	std::ofstream file;
+	file.open("perf_dedup.txt");
+
+	long double frames = (std::max)(dedup->GetClears(), std::uint64_t(1));
+	long double lookups = (std::max)(dedup->GetLookups(), std::uint64_t(1));
+	auto hits = dedup->GetHits();
+
+	file << "Deduplication over " << NUM_RENDER_OBJECTS << " objects with " << CB_DEDUP_DISTINCT_PAYLOADS << " distinct payloads:\n";
+	file << "\tHit rate: " << hits / lookups * 100 << "%\n";
+	file << "\tDistinct payloads per frame: " << (dedup->GetLookups() - hits) / frames << '\n';
+	file << "\tBytes written per frame: " << (dedup->GetLookups() - hits) * sizeof(CBPerObject) / frames
+		<< ", saved per frame: " << hits * sizeof(CBPerObject) / frames << '\n';
+	file << "\tProbes per lookup: " << dedup->GetProbes() / lookups << '\n';
+
+	file.close();
 }
+#endif // CB_DEDUP
 
-void BufferPerfApp::Update()
+#ifdef CB_PAYLOAD_COMPACT
+void BufferPerfApp::EncodePayload(CBPerObject const & data, PackedPayload& payload) const
 {
-	PROFILER_BEGIN_CPU("update")
-	for (auto& obj : draw_list)
-	{
-		/* COLLECT DATA */
-		CBPerObject data;
-		data.pos = obj.pos;
-		data.color = obj.color;
-
-		/* UPDATE CONSTANT BUFFERS */
-#ifdef CB_MAP_ON_UPDATE
-		void* adress;
-		CD3DX12_RANGE readRange(0, 0);
-#ifdef CB_BIG_BUFFER
-		big_cb_buffers[frame_idx]->Map(0, &readRange, &adress);
-#else // CB_BIG_BUFFER
-		obj.const_buffer->buffers[frame_idx]->Map(0, &readRange, &adress);
-#endif // CB_BIG_BUFFER
-#endif
-
-		unsigned int mul_size = (sizeof(CBPerObject) + 255) & ~255;
-#ifdef CB_MAP_ON_UPDATE
-#ifdef CB_BIG_BUFFER
-		std::memcpy((UINT8*)adress + obj.const_buffer->offset, &data, mul_size);
+#ifdef CB_PAYLOAD_HALF
+	PackHalf(&data.pos.x, &data.color.x, payload);
 #else
-		std::memcpy(adress, &data, mul_size);
+	PackQuantized(&data.pos.x, &data.color.x, &payload_origin.x, payload_origin.w, payload);
 #endif
-#endif // CB_MAP_ON_UPDATE
-#ifdef CB_MAP_ON_CREATION
-#ifdef CB_BIG_BUFFER
-		std::memcpy((UINT8*)big_cb_addresses[frame_idx] + obj.const_buffer->offset, &data, mul_size);
-#else // CB_BIG_BUFFER
-		std::memcpy(obj.const_buffer->addresses[frame_idx], &data, mul_size);
-#endif // CB_BIG_BUFFER
-#endif // CB_MAP_ON_CREATION
+}
 
-#if defined CB_MAP_ON_UPDATE && defined CB_UNMAP
-#ifdef CB_BIG_BUFFER
-		big_cb_buffers[frame_idx]->Unmap(0, &readRange);
-#else // CB_BIG_BUFFER
-		obj.const_buffer->buffers[frame_idx]->Unmap(0, &readRange);
-#endif // CB_BIG_BUFFER
-#endif // CB_MAP_ON_UPDATE && CB_UNMAP
+// Instructions of a compiled shader, a rough measure of its ALU cost.
+static UINT CountInstructions(ID3DBlob* shader)
+{
+	ComPtr<ID3D12ShaderReflection> reflection;
+	HRESULT hr = D3DReflect(shader->GetBufferPointer(), shader->GetBufferSize(), IID_PPV_ARGS(&reflection));
+	if (FAILED(hr))
+	{
+		throw "Failed to reflect shader";
 	}
-	PROFILER_END_CPU("update")
+
+	D3D12_SHADER_DESC desc;
+	reflection->GetDesc(&desc);
+	return desc.InstructionCount;
 }
 
-void BufferPerfApp::Render()
+void BufferPerfApp::PerfOutput_Payload()
 {
-	WaitForPrevFrame();
+	std::ofstream file;
+	file.open("perf_payload.txt");
 
-	UpdateFramerate();
+	// Pack the scene over and over, isolated from the rest of the update.
+	static constexpr std::uint32_t repetitions = 10000;
+	auto measure = [this](auto pack)
+	{
+		volatile std::uint32_t sink = 0;
+		auto start = profiler::Now();
+		for (std::uint32_t i = 0; i < repetitions; i++)
+		{
+			for (auto const & obj : draw_list)
+			{
+				CBPerObject data = { obj.pos, obj.color };
+				PackedPayload payload;
+				pack(data, payload);
+				sink = sink ^ payload.pos[0] ^ payload.pos[1] ^ payload.color;
+			}
+		}
+		return profiler::Duration(profiler::Now() - start).count();
+	};
+	long double packing = measure([this](CBPerObject const & data, PackedPayload& payload) { EncodePayload(data, payload); });
+	// The same with the scalar code, which EncodePayload uses as well unless PAYLOAD_PACKING_AVX2 is on.
+	long double scalar_packing = measure([this](CBPerObject const & data, PackedPayload& payload)
+	{
+#ifdef CB_PAYLOAD_HALF
+		PackHalfScalar(&data.pos.x, &data.color.x, payload);
+#else
+		PackQuantizedScalar(&data.pos.x, &data.color.x, &payload_origin.x, payload_origin.w, payload);
+#endif
+	});
+
+	// Compiled again without the decoding, the float vertex shader doesn't read the position at all.
+	auto float_defines = GetConstantBufferDefines(false);
+	auto defines = GetConstantBufferDefines(true);
+	std::array<UINT, 2> float_instructions = {
+		CountInstructions(LoadShader("cb_vertex.hlsl", "main", "vs_5_0", float_defines.data()).first),
+		CountInstructions(LoadShader("cb_pixel.hlsl", "main", "ps_5_0", float_defines.data()).first) };
+	std::array<UINT, 2> instructions = {
+		CountInstructions(LoadShader("cb_vertex.hlsl", "main", "vs_5_0", defines.data()).first),
+		CountInstructions(LoadShader("cb_pixel.hlsl", "main", "ps_5_0", defines.data()).first) };
+
+	file << "Payload encoding over " << NUM_RENDER_OBJECTS << " objects:\n";
+	file << "\tPacking (" << (IsPackingVectorized() ? "SIMD" : "scalar") << "): " << repetitions * draw_list.size() / packing << " objects per ms, "
+		<< packing * 1000000 / (repetitions * draw_list.size()) << "ns per object\n";
+	file << "\tScalar packing: " << repetitions * draw_list.size() / scalar_packing << " objects per ms, "
+		<< scalar_packing * 1000000 / (repetitions * draw_list.size()) << "ns per object, " << scalar_packing / packing << " times the time of the packing above\n";
+	file << "\tBytes written per object: " << sizeof(CBPayload) << " instead of " << sizeof(CBPerObject) << '\n';
+	file << "\tVertex shader instructions: " << instructions[0] << " instead of " << float_instructions[0] << '\n';
+	file << "\tPixel shader instructions: " << instructions[1] << " instead of " << float_instructions[1] << '\n';
 
-	ResetVersionedCommandListAndAllocator(cmd_list, cmd_allocators, frame_idx, pipeline);
+	file.close();
+}
+#endif // CB_PAYLOAD_COMPACT
 
-	// ### BEGIN RECORDING ###
-	auto begin_transition = CD3DX12_RESOURCE_BARRIER::Transition(
-		render_targets[frame_idx].Get(),
-		D3D12_RESOURCE_STATE_PRESENT,
-		D3D12_RESOURCE_STATE_RENDER_TARGET);
-	cmd_list->ResourceBarrier(1, &begin_transition);
+void BufferPerfApp::CreateCommandList()
+{
+	direct_pool = std::make_unique<CommandListPool>(device, D3D12_COMMAND_LIST_TYPE_DIRECT, COMMAND_POOL_LARGE_THRESHOLD, L"Direct Command List");
+#ifdef CB_BUNDLES
+	bundle_pool = std::make_unique<CommandListPool>(device, D3D12_COMMAND_LIST_TYPE_BUNDLE, COMMAND_POOL_LARGE_THRESHOLD, L"Bundle");
+#endif
+}
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(render_target_view_heap->GetCPUDescriptorHandleForHeapStart(), frame_idx, rtv_increment_size);
-	CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(depth_stencil_view_heap->GetCPUDescriptorHandleForHeapStart());
-	cmd_list->OMSetRenderTargets(1, &rtv_handle, false, &dsv_handle);
-	cmd_list->ClearRenderTargetView(rtv_handle, clear_color, 0, nullptr);
-	cmd_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+void BufferPerfApp::CreateFences()
+{
+	fence = std::make_unique<TimelineFence>(device, FENCE_SPIN_THRESHOLD_US, L"Direct Queue Fence");
+#ifdef DEFERRED_RELEASE_THREAD
+	release_queue = std::make_unique<DeferredReleaseQueue>(true);
+#else
+	release_queue = std::make_unique<DeferredReleaseQueue>(false);
+#endif
+#ifdef RESIDENCY_MANAGEMENT
+	residency = std::make_unique<ResidencyManager>(std::make_unique<D3D12ResidencyDevice>(device, adapter), (UINT64)RESIDENCY_BUDGET_MB * 1024 * 1024,
+		(UINT64)RESIDENCY_NON_LOCAL_BUDGET_MB * 1024 * 1024);
+#endif
+}
 
-	cmd_list->SetPipelineState(pipeline.Get());
-	cmd_list->SetGraphicsRootSignature(root_signature.Get());
+void BufferPerfApp::CreateFrameResources()
+{
+	// The old resources might still be used by frames in flight, they are released once the GPU is done with them.
+	// The new ones haven't been used yet, so there is nothing to wait for.
+	frame_in_flight_idx = 0;
+	frame_fence_values.assign(frames_in_flight, 0);
 
-	cmd_list->RSSetViewports(1, &viewport);
-	cmd_list->RSSetScissorRects(1, &scissor_rect);
+	// With instancing the per object data lives in the instance pages, there are no constant buffers.
+#ifndef INSTANCE_BATCHING
+#ifdef CB_BIG_BUFFER
+	for (auto& buffer : big_cb_buffers)
+	{
+#ifdef RESIDENCY_MANAGEMENT
+		residency->Untrack(buffer.Get());
+#endif
+		auto allocated = memory::GetAllocatedSize(device.Get(), buffer.Get());
+		release_queue->Retire([allocated] { memory::Free(memory::Category::ConstantData, sizeof(CBPerObject) * NUM_RENDER_OBJECTS, allocated); }, fence->GetLastSignaledValue());
+		release_queue->Retire(buffer, fence->GetLastSignaledValue());
+	}
+	big_cb_buffers.clear();
 
-	cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-	cmd_list->IASetVertexBuffers(0, 1, &vertex_buffer_view);
+	unsigned int mul_size = (sizeof(CBPerObject) + 255) & ~255;
+	current_offset = 0;
+	CreateBigConstantBuffer(mul_size * NUM_RENDER_OBJECTS);
+#endif
 
-	PROFILER_BEGIN_CPU("drawing");
 	for (auto& obj : draw_list)
 	{
-		cmd_list->SetGraphicsRootConstantBufferView(0, obj.const_buffer->gpu_addresses[frame_idx]);
-		//cmd_list->DrawIndexedInstanced(indices.size(), 1, 0, 0, 0);
-		cmd_list->DrawInstanced(vertices.size(), 1, 0, 0);
+		RetireConstantBuffer(obj.const_buffer);
+		CreateConstantBuffer(&obj.const_buffer, sizeof(CBPerObject));
 	}
-	PROFILER_END_CPU("drawing");
-
-	auto end_transition = CD3DX12_RESOURCE_BARRIER::Transition(
-		render_targets[frame_idx].Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		D3D12_RESOURCE_STATE_PRESENT
-	);
-	cmd_list->ResourceBarrier(1, &end_transition);
-	cmd_list->Close();
-	// ### STOPPED RECORDING ###
+#endif // INSTANCE_BATCHING
 
-	std::array<ID3D12CommandList*, 1> cmd_lists = { cmd_list.Get() };
-	cmd_queue->ExecuteCommandLists(cmd_lists.size(), cmd_lists.data());
+#ifdef CB_PARTITIONS
+	CreateFrameConstantBuffer();
+#endif
 
-	// GPU Signal
-	HRESULT hr = cmd_queue->Signal(fences[frame_idx].Get(), fence_values[frame_idx]);
-	if (FAILED(hr)) {
-		throw "Failed to set fence signal.";
+#ifdef CB_BUNDLES
+	for (auto bundle : bundles)
+	{
+		if (bundle)
+			bundle_pool->Release(bundle, fence->Get(), fence->GetLastSignaledValue());
 	}
+	bundles.assign(frames_in_flight, nullptr);
+	bundle_versions.assign(frames_in_flight, 0);
+#endif
+
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	frame_start_times.assign(frames_in_flight, profiler::Now());
+	frame_submitted.assign(frames_in_flight, false);
+#endif
 }
 
-void BufferPerfApp::CreateCommandList()
+void BufferPerfApp::SetFramesInFlight(std::uint32_t num)
 {
-	auto cmd_list_and_allocators = CreateVersionedCommandListAndAllocators(device, D3D12_COMMAND_LIST_TYPE_DIRECT);
-	cmd_list = cmd_list_and_allocators.first;
-	cmd_allocators = cmd_list_and_allocators.second;
+	frames_in_flight = num;
+	CreateFrameResources();
 }
 
-void BufferPerfApp::CreateFences()
+void BufferPerfApp::RetireConstantBuffer(ConstantBuffer* cb)
 {
-	HRESULT hr;
+	if (!cb)
+		return;
 
-	// create the fences
-	for (int i = 0; i < num_backbuffers; i++)
-	{
-		hr = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fences[i]));
-		if (FAILED(hr))
-		{
-			throw "Failed to create fence.";
-		}
-		fence_values[i] = 0; // set the initial fence value to 0
-	}
+#if defined RESIDENCY_MANAGEMENT && !defined CB_BIG_BUFFER
+	for (auto& buffer : cb->buffers)
+		residency->Untrack(buffer.Get());
+#endif
 
-	// create a handle to a fence event
-	fence_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (fence_event == nullptr)
+	// Everything signaled so far might still use it. Deleting it drops the references to its buffers.
+	release_queue->Retire([cb, device = device.Get()]
 	{
-		throw "Failed to create fence event.";
-	}
+#ifndef CB_BIG_BUFFER
+		for (auto& buffer : cb->buffers)
+			memory::Free(memory::Category::ConstantData, sizeof(CBPerObject), memory::GetAllocatedSize(device, buffer.Get()));
+#endif
+		delete cb;
+	}, fence->GetLastSignaledValue());
+}
+
+#ifdef RESIDENCY_MANAGEMENT
+void BufferPerfApp::TrackResidency(ID3D12Resource* resource)
+{
+	auto desc = resource->GetDesc();
+	auto info = device->GetResourceAllocationInfo(0, 1, &desc);
+	residency->Track(resource, info.SizeInBytes, GetMemorySegment(device.Get(), resource));
+}
+
+void BufferPerfApp::MarkFrameResidency()
+{
+	// Nothing is submitted before this frame, so everything it uses completes with the next signal.
+	auto fence_value = fence->GetNextValue();
+
+	residency->MarkUsed(depth_stencil_buffer.Get(), fence_value);
+	residency->MarkUsed(vertex_buffer.Get(), fence_value);
+#if defined INSTANCE_BATCHING
+	// As many pages as the last frame filled, the batch build marks any it takes beyond them.
+	for (auto page : instance_batcher->GetPagesToReuse())
+		residency->MarkUsed(page, fence_value);
+#elif defined CB_BIG_BUFFER
+	residency->MarkUsed(big_cb_buffers[frame_in_flight_idx].Get(), fence_value);
+#else
+	for (auto const & obj : draw_list)
+		residency->MarkUsed(obj.const_buffer->buffers[frame_in_flight_idx].Get(), fence_value);
+#endif
+#ifdef CB_DEFAULT_HEAP
+	// Written by the flush of this frame, which is submitted before the frame signals.
+	if (read_default_heap)
+		residency->MarkUsed(constant_uploader->GetBuffer(frame_in_flight_idx), fence_value);
+#endif
+#ifdef CB_PARTITIONS
+	residency->MarkUsed(material_uploader->GetBuffer(frame_in_flight_idx), fence_value);
+	residency->MarkUsed(frame_cb_buffer.Get(), fence_value);
+#endif
 }
+#endif // RESIDENCY_MANAGEMENT
 
 void BufferPerfApp::CreateRootSignature()
 {
 	std::array<D3D12_STATIC_SAMPLER_DESC, 0> samplers;
-	std::array<CD3DX12_ROOT_PARAMETER, 1> parameters_1_0;
-	parameters_1_0[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
-	std::array<CD3DX12_ROOT_PARAMETER1, 1> parameters_1_1;
-	parameters_1_1[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_PIXEL);
+#if defined INSTANCE_VERTEX_BUFFER
+	// Everything comes in through the input assembler.
+	std::array<CD3DX12_ROOT_PARAMETER, 0> parameters_1_0;
+	std::array<CD3DX12_ROOT_PARAMETER1, 0> parameters_1_1;
+#elif defined VERTEX_PULLING
+	std::array<CD3DX12_ROOT_PARAMETER, 3> parameters_1_0;
+	parameters_1_0[0].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_0[1].InitAsShaderResourceView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_0[2].InitAsShaderResourceView(1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	std::array<CD3DX12_ROOT_PARAMETER1, 3> parameters_1_1;
+	parameters_1_1[0].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_1[1].InitAsShaderResourceView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_1[2].InitAsShaderResourceView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_VERTEX);
+#elif defined CB_ARRAY
+	std::array<CD3DX12_ROOT_PARAMETER, 2> parameters_1_0;
+	parameters_1_0[0].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters_1_0[1].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	std::array<CD3DX12_ROOT_PARAMETER1, 2> parameters_1_1;
+	parameters_1_1[0].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters_1_1[1].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_PIXEL);
+#elif defined INSTANCING
+	std::array<CD3DX12_ROOT_PARAMETER, 2> parameters_1_0;
+	parameters_1_0[0].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_0[1].InitAsShaderResourceView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	std::array<CD3DX12_ROOT_PARAMETER1, 2> parameters_1_1;
+	parameters_1_1[0].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_1[1].InitAsShaderResourceView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_VERTEX);
+#elif defined CB_PARTITIONS
+	// Root parameters: 0 per object, 1 per frame, 2 per material
+	std::array<CD3DX12_ROOT_PARAMETER, 3 + num_payload_parameters> parameters_1_0;
+	parameters_1_0[0].InitAsConstantBufferView(0, 0, object_cb_visibility);
+	parameters_1_0[1].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters_1_0[2].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	std::array<CD3DX12_ROOT_PARAMETER1, 3 + num_payload_parameters> parameters_1_1;
+#ifdef CB_DEFAULT_HEAP
+	parameters_1_1[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, object_cb_visibility);
+#else
+	parameters_1_1[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, object_cb_visibility);
+#endif
+	// Bundles keep the per frame binding over many frames, and the copy queue writes the materials after recording.
+	parameters_1_1[1].InitAsConstantBufferView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters_1_1[2].InitAsConstantBufferView(2, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_PIXEL);
+#else
+	std::array<CD3DX12_ROOT_PARAMETER, 1 + num_payload_parameters> parameters_1_0;
+	parameters_1_0[0].InitAsConstantBufferView(0, 0, object_cb_visibility);
+	std::array<CD3DX12_ROOT_PARAMETER1, 1 + num_payload_parameters> parameters_1_1;
+#ifdef CB_DEFAULT_HEAP
+	// The copy queue writes the data after the draws were recorded.
+	parameters_1_1[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, object_cb_visibility);
+#else
+	parameters_1_1[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, object_cb_visibility);
+#endif
+#endif
+#ifdef CB_PAYLOAD_QUANTIZED
+	parameters_1_0[payload_origin_parameter].InitAsConstants(4, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	parameters_1_1[payload_origin_parameter].InitAsConstants(4, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+#endif
+
+#ifdef VERTEX_PULLING
+	D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+#else
+	D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+#endif
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
 	// Root signature version 1.0
@@ -235,14 +1705,14 @@ void BufferPerfApp::CreateRootSignature()
 		parameters_1_0.data(),
 		samplers.size(),
 		samplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+		flags);
 	// Root signature version 1.1
 	root_signature_desc.Init_1_1(
 		parameters_1_1.size(),
 		parameters_1_1.data(),
 		samplers.size(),
 		samplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+		flags);
 
 	ID3DBlob* signature;
 	ID3DBlob* error = nullptr;
@@ -268,16 +1738,54 @@ void BufferPerfApp::CreatePipelineStateObject()
 	rasterize_desc.CullMode = D3D12_CULL_MODE_NONE;
 	DXGI_SAMPLE_DESC sampleDesc = { 1, 0 };
 
+#ifdef VERTEX_PULLING
+	// The shader fetches everything itself.
+	input_layout.clear();
+#else
 	input_layout = {
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+#ifdef INSTANCE_VERTEX_BUFFER
+		// Tightly packed CBPerObject, one per instance.
+		{ "INSTANCE_POS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(CBPerObject, pos), D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCE_COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(CBPerObject, color), D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+#endif
 	};
+#endif
 
 	D3D12_INPUT_LAYOUT_DESC input_layout_desc = {};
 	input_layout_desc.NumElements = input_layout.size();
 	input_layout_desc.pInputElementDescs = input_layout.data();
 
+#ifdef INSTANCING
+	auto vertex_shader = LoadShader("instanced_vertex.hlsl", "main", "vs_5_0");
+	auto pixel_shader = LoadShader("instanced_pixel.hlsl", "main", "ps_5_0");
+#elif defined VERTEX_PULLING
+	// The layout comes from the C++ structs so the two can't drift apart.
+	auto vertex_stride = std::to_string(sizeof(Vertex));
+	auto instance_stride = std::to_string(sizeof(CBPerObject));
+	auto color_offset = std::to_string(offsetof(CBPerObject, color));
+	std::array<D3D_SHADER_MACRO, 4> defines = { {
+		{ "VERTEX_STRIDE", vertex_stride.c_str() },
+		{ "INSTANCE_STRIDE", instance_stride.c_str() },
+		{ "INSTANCE_COLOR_OFFSET", color_offset.c_str() },
+		{ nullptr, nullptr } } };
+	auto vertex_shader = LoadShader("pulling_vertex.hlsl", "main", "vs_5_0", defines.data());
+	auto pixel_shader = LoadShader("instanced_pixel.hlsl", "main", "ps_5_0");
+#elif defined CB_ARRAY
+	// The array covers the whole page, the shader never reads past the objects of the current batch.
+	auto objects_per_buffer = std::to_string(INSTANCE_PAGE_SIZE / sizeof(CBPerObject));
+	std::array<D3D_SHADER_MACRO, 3> defines = { { { "CB_ARRAY", "1" }, { "OBJECTS_PER_BUFFER", objects_per_buffer.c_str() }, { nullptr, nullptr } } };
 	auto vertex_shader = LoadShader("cb_vertex.hlsl", "main", "vs_5_0");
-	auto pixel_shader = LoadShader("cb_pixel.hlsl", "main", "ps_5_0");
+	auto pixel_shader = LoadShader("cb_pixel.hlsl", "main", "ps_5_0", defines.data());
+#elif defined INSTANCE_VERTEX_BUFFER
+	std::array<D3D_SHADER_MACRO, 2> defines = { { { "INSTANCE_VERTEX_BUFFER", "1" }, { nullptr, nullptr } } };
+	auto vertex_shader = LoadShader("cb_vertex.hlsl", "main", "vs_5_0", defines.data());
+	auto pixel_shader = LoadShader("cb_pixel.hlsl", "main", "ps_5_0", defines.data());
+#else
+	auto defines = GetConstantBufferDefines(true);
+	auto vertex_shader = LoadShader("cb_vertex.hlsl", "main", "vs_5_0", defines.data());
+	auto pixel_shader = LoadShader("cb_pixel.hlsl", "main", "ps_5_0", defines.data());
+#endif
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC pso_desc = {};
 	pso_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
@@ -298,13 +1806,45 @@ void BufferPerfApp::CreatePipelineStateObject()
 		throw "Failed to create graphics pipeline";
 	}
 	pipeline->SetName(L"Generic pipeline object");
+
+#ifdef MULTI_STATE_WORKLOAD
+	// Same shaders and root signature, but still distinct pipelines the GPU has to switch between.
+	pipelines[0] = pipeline;
+	for (auto i = 1; i < NUM_PIPELINES; i++)
+	{
+		pso_desc.RasterizerState.DepthBias = i;
+		pso_desc.RasterizerState.FillMode = i % 2 ? D3D12_FILL_MODE_WIREFRAME : D3D12_FILL_MODE_SOLID;
+
+		hr = device->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(&pipelines[i]));
+		if (FAILED(hr))
+		{
+			throw "Failed to create graphics pipeline";
+		}
+		pipelines[i]->SetName(L"Workload pipeline object");
+	}
+#endif
 }
 
-void BufferPerfApp::CreateVertexBuffer()
+void BufferPerfApp::CreateVertexBuffer(ID3D12GraphicsCommandList2* cmd_list)
 {
+#ifdef MULTI_STATE_WORKLOAD
+	// Every mesh is the quad at a different scale, all of them in one buffer.
+	std::vector<Vertex> mesh_vertices;
+	for (auto m = 0; m < NUM_MESHES; m++)
+	{
+		float scale = 1.0f - m * (0.75f / NUM_MESHES);
+		for (auto const & v : vertices)
+			mesh_vertices.emplace_back(DirectX::XMFLOAT3(v.pos.x * scale, v.pos.y * scale, v.pos.z));
+	}
+	vertex_buffer_size = sizeof(Vertex) * mesh_vertices.size();
+	void const * vertex_source = mesh_vertices.data();
+#else
 	vertex_buffer_size = sizeof(vertices);
+	void const * vertex_source = vertices.data();
+#endif
 
-	device->CreateCommittedResource(
+	interposer::CreateCommittedResource(
+		device.Get(),
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 		D3D12_HEAP_FLAG_NONE,
 		&CD3DX12_RESOURCE_DESC::Buffer(vertex_buffer_size),
@@ -313,8 +1853,10 @@ void BufferPerfApp::CreateVertexBuffer()
 		IID_PPV_ARGS(&vertex_buffer));
 
 	vertex_buffer->SetName(L"Vertex Buffer Resource Heap");
+	memory::Allocate(memory::Category::Geometry, vertex_buffer_size, memory::GetAllocatedSize(device.Get(), vertex_buffer.Get()));
 
-	device->CreateCommittedResource(
+	interposer::CreateCommittedResource(
+		device.Get(),
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 		D3D12_HEAP_FLAG_NONE,
 		&CD3DX12_RESOURCE_DESC::Buffer(vertex_buffer_size),
@@ -323,38 +1865,81 @@ void BufferPerfApp::CreateVertexBuffer()
 		IID_PPV_ARGS(&vb_upload_heap));
 
 	vb_upload_heap->SetName(L"Vertex Buffer Upload Resource Heap");
+	memory::Allocate(memory::Category::Staging, vertex_buffer_size, memory::GetAllocatedSize(device.Get(), vb_upload_heap.Get()));
 
 	// store vertex buffer in upload heap
 	D3D12_SUBRESOURCE_DATA vertex_data = {};
-	vertex_data.pData = vertices.data();
+	vertex_data.pData = vertex_source;
 	vertex_data.RowPitch = vertex_buffer_size;
 	vertex_data.SlicePitch = vertex_buffer_size;
 
-	UpdateSubresources(cmd_list.Get(), vertex_buffer.Get(), vb_upload_heap.Get(), 0, 0, 1, &vertex_data);
+	UpdateSubresources(cmd_list, vertex_buffer.Get(), vb_upload_heap.Get(), 0, 0, 1, &vertex_data);
 
 	// transition the vertex buffer data from copy destination state to vertex buffer state
+#ifdef VERTEX_PULLING
+	// Read through a root SRV instead of the input assembler.
+	cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(vertex_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+#else
 	cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(vertex_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
+#endif
 
 	// create a vertex buffer view for the rectangle. We get the GPU memory address to the vertex buffer using the GetGPUVirtualAddress() method
 	vertex_buffer_view.BufferLocation = vertex_buffer->GetGPUVirtualAddress();
 	vertex_buffer_view.StrideInBytes = sizeof(Vertex);
 	vertex_buffer_view.SizeInBytes = vertex_buffer_size;
+
+#ifdef MULTI_STATE_WORKLOAD
+	for (auto m = 0; m < NUM_MESHES; m++)
+	{
+		mesh_views[m].BufferLocation = vertex_buffer_view.BufferLocation + m * sizeof(vertices);
+		mesh_views[m].StrideInBytes = sizeof(Vertex);
+		mesh_views[m].SizeInBytes = sizeof(vertices);
+	}
+#endif
 }
 
 void BufferPerfApp::WaitForPrevFrame()
 {
-	if (fences[frame_idx]->GetCompletedValue() < fence_values[frame_idx])
+	// Wait for the last frame that used this frame's resources.
+	fence->Wait(frame_fence_values[frame_in_flight_idx], "frame_in_flight");
+	release_queue->Collect(fence->GetCompletedValue());
+#ifdef INSTANCE_BATCHING
+	// The wait for this frame in flight just finished, so the pages of that frame can be reused.
+	instance_batcher->Begin(fence->GetCompletedValue());
+#endif
+#ifdef RESIDENCY_MANAGEMENT
+	// Between frames, so neither Evict nor MakeResident lands in the middle of recording. What this frame uses is marked
+	// before the budget is enforced, otherwise its buffers, last used frames_in_flight frames ago, would be the first to go.
+	// They are resident again before the update writes them.
+	MarkFrameResidency();
+	residency->EnforceBudget(fence->GetCompletedValue());
+	residency->MakeUsedResident();
+#endif
+
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	auto now = profiler::Now();
+	auto& stats = depth_stats[frames_in_flight - 1];
+
+	// Latency is measured from the start of a frame until its completion is observed, which has a granularity of one frame.
+	for (std::uint32_t i = 0; i < frames_in_flight; i++)
 	{
-		HRESULT hr = fences[frame_idx]->SetEventOnCompletion(fence_values[frame_idx], fence_event);
-		if (FAILED(hr))
+		if (frame_submitted[i] && fence->IsCompleted(frame_fence_values[i]))
 		{
-			throw "Failed to set fence event.";
+			stats.latency_sum += profiler::Duration(now - frame_start_times[i]).count();
+			stats.latency_samples++;
+			frame_submitted[i] = false;
 		}
+	}
 
-		WaitForSingleObject(fence_event, INFINITE);
+	if (stats.frames > 0)
+	{
+		stats.frame_time_sum += profiler::Duration(now - prev_frame_start).count();
 	}
+	stats.frames++;
 
-	fence_values[frame_idx]++;
+	prev_frame_start = now;
+	frame_start_times[frame_in_flight_idx] = now;
+#endif
 }
 
 void BufferPerfApp::UpdateFramerate()
@@ -374,8 +1959,14 @@ void BufferPerfApp::UpdateFramerate()
 #ifdef CB_BIG_BUFFER
 void BufferPerfApp::CreateBigConstantBuffer(std::uint32_t size)
 {
-	for (unsigned int i = 0; i < D3D12App::num_backbuffers; ++i) {
-		HRESULT hr = device->CreateCommittedResource(
+	big_cb_buffers.resize(frames_in_flight);
+#ifdef CB_MAP_ON_CREATION
+	big_cb_addresses.resize(frames_in_flight);
+#endif
+
+	for (unsigned int i = 0; i < frames_in_flight; ++i) {
+		HRESULT hr = interposer::CreateCommittedResource(
+			device.Get(),
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 			D3D12_HEAP_FLAG_NONE,
 			&CD3DX12_RESOURCE_DESC::Buffer(size),
@@ -386,10 +1977,14 @@ void BufferPerfApp::CreateBigConstantBuffer(std::uint32_t size)
 			throw "Failed to create constant buffer resource";
 		}
 		big_cb_buffers[i]->SetName(L"Constant Buffer Upload Resource Heap");
+		memory::Allocate(memory::Category::ConstantData, sizeof(CBPerObject) * NUM_RENDER_OBJECTS, memory::GetAllocatedSize(device.Get(), big_cb_buffers[i].Get()));
+#ifdef RESIDENCY_MANAGEMENT
+		TrackResidency(big_cb_buffers[i].Get());
+#endif
 
 #ifdef CB_MAP_ON_CREATION
 		CD3DX12_RANGE readRange(0, 0);
-		hr = big_cb_buffers[i]->Map(0, &readRange, &big_cb_addresses[i]);
+		hr = interposer::Map(big_cb_buffers[i].Get(), 0, &readRange, &big_cb_addresses[i]);
 		if (FAILED(hr)) {
 			throw "Failed to map constant buffer";
 		}
@@ -402,16 +1997,31 @@ void BufferPerfApp::CreateConstantBuffer(ConstantBuffer** cb, std::uint32_t size
 {
 	ConstantBuffer* new_cb = new ConstantBuffer();
 	unsigned int mul_size = (size + 255) & ~255;
+	new_cb->gpu_addresses.resize(frames_in_flight);
+#ifndef CB_BIG_BUFFER
+	new_cb->buffers.resize(frames_in_flight);
+#ifdef CB_MAP_ON_CREATION
+	new_cb->addresses.resize(frames_in_flight);
+#endif
+#endif
 
 #ifdef CB_BIG_BUFFER
-	for (unsigned int i = 0; i < D3D12App::num_backbuffers; ++i) {
-		new_cb->gpu_addresses[i] = big_cb_buffers[i]->GetGPUVirtualAddress() + current_offset;
+	for (unsigned int i = 0; i < frames_in_flight; ++i) {
+		new_cb->gpu_addresses[i] = interposer::GetGPUVirtualAddress(big_cb_buffers[i].Get()) + current_offset;
 	}
 	new_cb->offset = current_offset;
+#ifdef CB_DEFAULT_HEAP
+	new_cb->slot = static_cast<std::uint32_t>(current_offset / mul_size);
+	new_cb->default_heap_addresses.resize(frames_in_flight);
+	for (unsigned int i = 0; i < frames_in_flight; ++i) {
+		new_cb->default_heap_addresses[i] = constant_uploader->GetSlotAddress(i, new_cb->slot);
+	}
+#endif
 	current_offset += mul_size;
 #else // CB_BIG_BUFFER
-	for (unsigned int i = 0; i < D3D12App::num_backbuffers; ++i) {
-		HRESULT hr = device->CreateCommittedResource(
+	for (unsigned int i = 0; i < frames_in_flight; ++i) {
+		HRESULT hr = interposer::CreateCommittedResource(
+			device.Get(),
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 			D3D12_HEAP_FLAG_NONE,
 			&CD3DX12_RESOURCE_DESC::Buffer(mul_size),
@@ -422,15 +2032,19 @@ void BufferPerfApp::CreateConstantBuffer(ConstantBuffer** cb, std::uint32_t size
 			throw "Failed to create constant buffer resource";
 		}
 		new_cb->buffers[i]->SetName(L"Constant Buffer Upload Resource Heap");
+		memory::Allocate(memory::Category::ConstantData, size, memory::GetAllocatedSize(device.Get(), new_cb->buffers[i].Get()));
+#ifdef RESIDENCY_MANAGEMENT
+		TrackResidency(new_cb->buffers[i].Get());
+#endif
 
 #ifdef CB_MAP_ON_CREATION
 		CD3DX12_RANGE readRange(0, 0);
-		hr = new_cb->buffers[i]->Map(0, &readRange, &new_cb->addresses[i]);
+		hr = interposer::Map(new_cb->buffers[i].Get(), 0, &readRange, &new_cb->addresses[i]);
 		if (FAILED(hr)) {
 			throw "Failed to map constant buffer";
 		}
 #endif // CB_MAP_ON_CREATION
-		new_cb->gpu_addresses[i] = new_cb->buffers[i]->GetGPUVirtualAddress();
+		new_cb->gpu_addresses[i] = interposer::GetGPUVirtualAddress(new_cb->buffers[i].Get());
 }
 #endif // CB_BIG_BUFFER
 
@@ -465,13 +2079,248 @@ void BufferPerfApp::PerfOutput_Framerate()
 	file.close();
 }
 
+#ifdef PIPELINED_SIMULATION
+void BufferPerfApp::SimulationLoop()
+{
+	std::unique_lock<std::mutex> lock(sim_mutex);
+	while (true)
+	{
+		// Stay at most one snapshot ahead of the renderer, sleeping until ConsumeSnapshot picks up the last one.
+		sim_wakeup.wait(lock, [this] { return !sim_running || (!sim_inline && !snapshots.HasUnconsumed()); });
+		if (!sim_running)
+			break;
+
+		sim_busy = true;
+		lock.unlock();
+		SimulationTick();
+		lock.lock();
+		sim_busy = false;
+		// The render thread might be waiting to take over.
+		sim_wakeup.notify_all();
+	}
+}
+
+void BufferPerfApp::SimulationTick()
+{
+	auto start = profiler::Now();
+
+	// Long stalls are clamped so the objects don't jump across their bounds.
+	auto dt = (std::min)(profiler::Duration(start - sim_prev_tick).count() / 1000, 0.1L);
+	sim_prev_tick = start;
+	Simulate((float)dt);
+
+	auto& snapshot = snapshots.GetWriteBuffer();
+	CollectSnapshot(snapshot);
+	snapshot.tick = ++sim_ticks;
+	snapshot.published = profiler::Now();
+	snapshots.Publish();
+
+	sim_time += profiler::Duration(snapshot.published - start).count();
+}
+
+void BufferPerfApp::Simulate(float dt)
+{
+	for (auto& obj : sim_objects)
+	{
+		float* pos = &obj.pos.x;
+		float* velocity = &obj.velocity.x;
+		float const * start = &obj.start.x;
+		for (auto axis = 0; axis < 3; axis++)
+		{
+			pos[axis] += velocity[axis] * dt;
+			// Reflect at the bounds, the overshoot is mirrored back inside.
+			float offset = pos[axis] - start[axis];
+			if (offset > PIPELINED_SIMULATION_BOUNDS || offset < -PIPELINED_SIMULATION_BOUNDS)
+			{
+				float bound = offset > 0 ? PIPELINED_SIMULATION_BOUNDS : -PIPELINED_SIMULATION_BOUNDS;
+				pos[axis] = start[axis] + 2 * bound - offset;
+				velocity[axis] = -velocity[axis];
+			}
+		}
+	}
+}
+
+void BufferPerfApp::CollectSnapshot(SceneSnapshot& snapshot)
+{
+	for (auto i = 0; i < NUM_RENDER_OBJECTS; i++)
+	{
+		snapshot.objects[i].pos = sim_objects[i].pos;
+		snapshot.objects[i].color = draw_list[i].color;
+	}
+}
+
+void BufferPerfApp::ConsumeSnapshot()
+{
+#ifdef PIPELINED_SIMULATION_SWEEP
+	SwitchSimulationThread();
+	if (sim_inline)
+	{
+		// The baseline, the frame waits for the simulation like it would without the pipeline.
+		SimulationTick();
+		snapshots.Acquire();
+		return;
+	}
+#endif
+
+	render_ticks++;
+	if (snapshots.Acquire())
+	{
+		fresh_snapshots++;
+		// Taking the lock makes sure the simulation thread can't miss the wakeup between checking and going to sleep.
+		{
+			std::lock_guard<std::mutex> lock(sim_mutex);
+		}
+		sim_wakeup.notify_all();
+	}
+
+	// Age of the data this frame is going to render.
+	snapshot_age_sum += profiler::Duration(profiler::Now() - snapshots.GetReadBuffer().published).count();
+}
+
+#ifdef PIPELINED_SIMULATION_SWEEP
+void BufferPerfApp::SwitchSimulationThread()
+{
+	auto now = profiler::Now();
+
+	// The first frames after a switch still wait for frames queued in the previous mode.
+	if (++pipeline_config_frames > MAX_FRAMES_IN_FLIGHT)
+	{
+		auto& totals = pipeline_sweep[sim_inline];
+		totals.frames++;
+		totals.frame_time_sum += profiler::Duration(now - prev_pipeline_frame).count();
+	}
+	prev_pipeline_frame = now;
+
+	if (pipeline_config_frames < PIPELINED_SIMULATION_SWEEP_FRAMES)
+		return;
+	pipeline_config_frames = 0;
+
+	std::unique_lock<std::mutex> lock(sim_mutex);
+	sim_inline = !sim_inline;
+	if (sim_inline)
+	{
+		// The simulation thread goes to sleep after the tick it is in, the render thread takes over from there.
+		sim_wakeup.wait(lock, [this] { return !sim_busy; });
+	}
+	else
+	{
+		lock.unlock();
+		sim_wakeup.notify_all();
+	}
+}
+#endif // PIPELINED_SIMULATION_SWEEP
+
+void BufferPerfApp::PerfOutput_Pipeline()
+{
+	std::ofstream file;
+	file.open("perf_pipeline.txt");
+
+#ifdef PIPELINED_SIMULATION_SWEEP
+	// full_frame covers both modes.
+	auto average = [](PipelineTotals const & totals) { return totals.frames ? totals.frame_time_sum / totals.frames : 0; };
+	auto frame_time = average(pipeline_sweep[0]);
+	auto inline_frame_time = average(pipeline_sweep[1]);
+#else
+	auto frame_time = profiler::GetAverage("full_frame");
+#endif
+	auto average_age = snapshot_age_sum / render_ticks;
+
+	file << "Pipelined simulation over " << render_ticks << " frames:\n";
+	file << "\tAverage frame time: " << frame_time << "ms\n";
+#ifdef PIPELINED_SIMULATION_SWEEP
+	file << "\tAverage frame time simulating on the render thread: " << inline_frame_time << "ms\n";
+	if (frame_time > 0 && inline_frame_time > 0)
+		file << "\tThroughput gained by the pipeline: " << (inline_frame_time / frame_time - 1) * 100 << "%\n";
+#endif
+	file << "\tAverage simulation time (off the render thread): " << sim_time / sim_ticks << "ms\n";
+	file << "\tSnapshots produced: " << sim_ticks << '\n';
+	file << "\tFrames with a fresh snapshot: " << fresh_snapshots << '\n';
+	file << "\tAverage snapshot age: " << average_age << "ms\n";
+	file << "\tAdded latency: " << average_age / frame_time << " frames\n";
+
+	file.close();
+}
+#endif // PIPELINED_SIMULATION
+
+#ifdef PARALLEL_UPDATE_SWEEP
+void BufferPerfApp::PerfOutput_UpdateScaling()
+{
+	std::ofstream file;
+	file.open("perf_update_scaling.txt");
+
+	auto single_thread = profiler::GetAverage("update_1_threads");
+
+	file << "Update scaling over " << NUM_RENDER_OBJECTS << " objects:\n";
+	for (std::uint32_t i = 1; i <= job_system.GetNumThreads(); i++)
+	{
+		auto name = "update_" + std::to_string(i) + "_threads";
+		if (profiler::cpu_results.find(name) == profiler::cpu_results.end())
+			continue;
+
+		// Efficiency is the speedup divided by the amount of threads. 1 means perfect scaling.
+		auto average = profiler::GetAverage(name);
+		auto speedup = single_thread / average;
+		file << "\t" << i << " threads: " << average << "ms, speedup " << speedup << ", efficiency " << speedup / i << '\n';
+	}
+
+	file.close();
+}
+#endif // PARALLEL_UPDATE_SWEEP
+
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+void BufferPerfApp::PerfOutput_FramesInFlight()
+{
+	std::ofstream file;
+	file.open("perf_frames_in_flight.txt");
+
+	unsigned int mul_size = (sizeof(CBPerObject) + 255) & ~255;
+
+	file << "Frames in flight sweep over " << NUM_RENDER_OBJECTS << " objects:\n";
+	for (std::uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		auto const & stats = depth_stats[i];
+		if (stats.frames < 2 || stats.latency_samples == 0)
+			continue;
+
+		auto frame_time = stats.frame_time_sum / (stats.frames - 1);
+		auto latency = stats.latency_sum / stats.latency_samples;
+
+		file << '\t' << i + 1 << " frames in flight:\n";
+		file << "\t\tAverage frame time: " << frame_time << "ms (" << 1000 / frame_time << " fps)\n";
+		file << "\t\tAverage latency: " << latency << "ms (" << latency / frame_time << " frames)\n";
+		file << "\t\tConstant buffer upload memory: " << (std::uint64_t)mul_size * NUM_RENDER_OBJECTS * (i + 1) << " bytes\n";
+	}
+
+	file.close();
+}
+#endif // FRAMES_IN_FLIGHT_SWEEP
+
+// Reads "-frames_in_flight N" from the command line.
+static std::uint32_t ParseFramesInFlight(std::string_view cmd_line)
+{
+	std::string_view const option = "-frames_in_flight";
+	auto pos = cmd_line.find(option);
+	if (pos == std::string_view::npos)
+		return DEFAULT_FRAMES_IN_FLIGHT;
+
+	int value = std::atoi(cmd_line.data() + pos + option.size());
+	if (value < 1 || value > MAX_FRAMES_IN_FLIGHT)
+		return DEFAULT_FRAMES_IN_FLIGHT;
+
+	return static_cast<std::uint32_t>(value);
+}
+
 #ifdef temp
 int main()
 #else
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, PSTR cmd_line, INT show_cmd)
 #endif
 {
-	BufferPerfApp* app = new BufferPerfApp();
+#ifdef temp
+	BufferPerfApp* app = new BufferPerfApp(DEFAULT_FRAMES_IN_FLIGHT);
+#else
+	BufferPerfApp* app = new BufferPerfApp(ParseFramesInFlight(cmd_line));
+#endif
 	app->InitDebugLayer();
 	app->SetupD3D12();
 #ifdef temp
@@ -5,22 +5,262 @@
 // GraphicsCommandList2
 // ID3D12Debug1
 
-// GetVirtualAddress every frame. What is the performance impact?
 
 #include "d3d12_app.hpp"
+#include "command_pool.hpp"
+#include "constant_uploader.hpp"
+#include "d3d12_residency_device.hpp"
+#include "dedup_table.hpp"
+#include "deferred_release.hpp"
+#include "draw_queue.hpp"
+#include "instance_batcher.hpp"
+#include "map_range_tracker.hpp"
+#include "memory_accounting.hpp"
+#include "payload_packing.hpp"
+#include "residency_manager.hpp"
+#include "shader_layout.hpp"
+#include "timeline_fence.hpp"
+#include "job_system.hpp"
+#include "triple_buffer.hpp"
 
 #include <vector>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <cstddef>
+#include <cstdlib>
+#include <string_view>
 
 //#define CB_MAP_ON_UPDATE
 //#define CB_UNMAP
 #define CB_MAP_ON_CREATION
 
+// With map and unmap on update, map every buffer once on its first write of a frame and unmap it once per frame
+// with the ranges that were written, gaps of up to CB_MAP_RANGE_MERGE_GAP bytes merged.
+//#define CB_MAP_RANGE_TRACKING
+#define CB_MAP_RANGE_MERGE_GAP 256
+
+#if defined CB_MAP_RANGE_TRACKING && !(defined CB_MAP_ON_UPDATE && defined CB_UNMAP)
+#error "Range tracking replaces the map and unmap per object."
+#endif
+
 #define CB_BIG_BUFFER
 
+// Query the GPU address of the constant buffers for every draw instead of caching it at creation.
+// Enable API_INTERPOSER in api_interposer.hpp to see what that costs per call.
+//#define CB_GPU_ADDRESS_PER_FRAME
+
 #define NUM_RENDER_OBJECTS 100
 
+// Spread the objects over several pipelines and meshes, interleaved so every draw changes state when they aren't sorted.
+//#define MULTI_STATE_WORKLOAD
+#define NUM_PIPELINES 4
+#define NUM_MESHES 4
+
+// Sort the draws by a key of their state before recording them.
+//#define DRAW_SORTING
+
+// Frames the CPU can run ahead of the GPU, independent of the amount of swap chain buffers.
+// Can be overridden with "-frames_in_flight N".
+#define DEFAULT_FRAMES_IN_FLIGHT 3
+#define MAX_FRAMES_IN_FLIGHT 8
+
+// Start with 1 frame in flight and go one deeper every FRAMES_IN_FLIGHT_SWEEP_FRAMES frames.
+//#define FRAMES_IN_FLIGHT_SWEEP
+#define FRAMES_IN_FLIGHT_SWEEP_FRAMES 2000
+
+#if defined FRAMES_IN_FLIGHT_SWEEP
+#undef DEFAULT_FRAMES_IN_FLIGHT
+#define DEFAULT_FRAMES_IN_FLIGHT 1
+#endif
+
+// Record the draws on multiple threads, each thread into its own command list.
+//#define MT_RECORDING
+#define NUM_RECORD_THREADS 4
+
+// Time to spin on a fence before going to sleep on an event.
+#define FENCE_SPIN_THRESHOLD_US 200
+
+// Release retired resources on a low priority thread instead of on the render thread.
+//#define DEFERRED_RELEASE_THREAD
+
+// Evict the least recently used heaps and resources when the memory usage of a segment exceeds its budget.
+// Default heaps count against the local budget, upload heaps against the non-local one unless the adapter is UMA.
+// A budget of 0 uses the budget the OS reports for the segment.
+//#define RESIDENCY_MANAGEMENT
+#define RESIDENCY_BUDGET_MB 0
+#define RESIDENCY_NON_LOCAL_BUDGET_MB 0
+
+// Allocators that recorded at least this many draws are kept apart from the small ones.
+#define COMMAND_POOL_LARGE_THRESHOLD 1024
+
+// Update the constant buffers on the thread pool. Falls back to the serial loop for small scenes.
+//#define PARALLEL_UPDATE
+//#define PARALLEL_UPDATE_SWEEP
+#define PARALLEL_UPDATE_MIN_OBJECTS 1024
+#define PARALLEL_UPDATE_MIN_OBJECTS_PER_CHUNK 256
+
+// Run the whole frame (fence wait, update, culling, recording and submission) as a task graph on the job system.
+//#define FRAME_TASK_GRAPH
+
+// Record the draws of every frame in flight once into a bundle and only re-record when the scene changes.
+//#define CB_BUNDLES
+
+#if defined CB_BUNDLES && defined MT_RECORDING
+#error "Bundles replace the per frame recording, they can't be combined with multi threaded recording."
+#endif
+
+// Close and submit the command list every few draws so the GPU can start while the rest of the frame is recorded.
+// The amount of draws per chunk adapts so a chunk takes about SPLIT_SUBMISSION_TARGET_US to record.
+//#define SPLIT_SUBMISSION
+#define SPLIT_SUBMISSION_INITIAL_DRAWS 256
+#define SPLIT_SUBMISSION_MIN_DRAWS 32
+#define SPLIT_SUBMISSION_TARGET_US 100
+
+#if defined SPLIT_SUBMISSION && (defined MT_RECORDING || defined CB_BUNDLES)
+#error "Split submission records on a single thread without bundles."
+#endif
+
+// Produce the per object data on a separate simulation thread, overlapping with recording and submission of the previous frame.
+// The simulation moves every object with its own constant velocity and bounces it back within PIPELINED_SIMULATION_BOUNDS of where it started.
+//#define PIPELINED_SIMULATION
+#define PIPELINED_SIMULATION_BOUNDS 0.5f
+#define PIPELINED_SIMULATION_SPEED 0.25f
+
+// Alternate between the simulation thread and simulating on the render thread before the update, which is what the frame
+// costs without the pipeline. Every mode runs for PIPELINED_SIMULATION_SWEEP_FRAMES frames and both frame times are reported.
+//#define PIPELINED_SIMULATION_SWEEP
+#define PIPELINED_SIMULATION_SWEEP_FRAMES 500
+
+#if defined PIPELINED_SIMULATION_SWEEP && !defined PIPELINED_SIMULATION
+#define PIPELINED_SIMULATION
+#endif
+
+#if defined FRAME_TASK_GRAPH && defined PIPELINED_SIMULATION
+#error "The frame graph already runs the update, it can't be combined with the pipelined simulation."
+#endif
+
+#if defined FRAME_TASK_GRAPH && !defined MT_RECORDING
+#define MT_RECORDING
+#endif
+
+// Draw objects that share pipeline and mesh as instances of one draw. The per object data is packed into a structured buffer
+// in draw order instead of a constant buffer per object, a root constant tells the shader where the batch starts.
+//#define INSTANCING
+#define INSTANCE_PAGE_SIZE 65536
+
+// Stream the per object data through a second vertex buffer with per instance elements, batched like INSTANCING.
+//#define INSTANCE_VERTEX_BUFFER
+
+// Batched like INSTANCING, but without the input assembler. The shader loads the vertices and the per object data from byte address buffers.
+//#define VERTEX_PULLING
+
+// Pack the per object data without padding into cbuffer arrays of up to 64KB. Every object still gets its own draw,
+// which selects its entry with a root constant. A new buffer is bound whenever the objects don't fit into the last one.
+//#define CB_ARRAY
+
+#if defined INSTANCING + defined INSTANCE_VERTEX_BUFFER + defined VERTEX_PULLING + defined CB_ARRAY > 1
+#error "Pick one way to get the per instance data to the shader."
+#endif
+
+// Everything that draws batches of instances out of the InstanceBatcher.
+#if defined INSTANCING || defined INSTANCE_VERTEX_BUFFER || defined VERTEX_PULLING || defined CB_ARRAY
+#define INSTANCE_BATCHING
+#endif
+
+#if defined CB_ARRAY && INSTANCE_PAGE_SIZE > 65536
+#error "A constant buffer can't be bigger than 64KB."
+#endif
+
+#if defined INSTANCE_BATCHING && (defined MT_RECORDING || defined CB_BUNDLES || defined SPLIT_SUBMISSION)
+#error "Instancing records a handful of draws on a single thread."
+#endif
+
+#if defined INSTANCE_BATCHING && !defined DRAW_SORTING
+#define DRAW_SORTING
+#endif
+
+// Keep the constant data in default heap buffers laid out like the big buffer, so the draws read local memory
+// instead of going over the bus. Objects that changed are staged in a small upload ring and copied by a dedicated copy queue
+// into the buffer of the frame in flight, which only waits for the last frame that read that buffer.
+//#define CB_DEFAULT_HEAP
+#define CB_UPLOAD_RING_SIZE (64 * 1024)
+// Share of the objects that changes every frame, the rest is only copied once.
+#define CB_DEFAULT_HEAP_CHANGED_PERCENT 100
+
+// Go from 0 to 100% changed objects and measure every step once reading the upload heap and once the default heap,
+// to find the share from which the copies don't pay off anymore.
+//#define CB_DEFAULT_HEAP_SWEEP
+#define CB_DEFAULT_HEAP_SWEEP_FRAMES 1000
+#define CB_DEFAULT_HEAP_SWEEP_STEP_PERCENT 10
+
+// Stage only the changed payloads as compact (slot index, payload) records and scatter them with a compute shader,
+// instead of copying whole 256 byte slots. Verification scatters on the CPU as well and compares at shutdown.
+//#define CB_DELTA_SCATTER
+//#define CB_DELTA_SCATTER_VERIFY
+
+#if defined CB_DELTA_SCATTER_VERIFY && !defined CB_DELTA_SCATTER
+#define CB_DELTA_SCATTER
+#endif
+
+#if (defined CB_DEFAULT_HEAP_SWEEP || defined CB_DELTA_SCATTER) && !defined CB_DEFAULT_HEAP
+#define CB_DEFAULT_HEAP
+#endif
+
+#if defined CB_DEFAULT_HEAP && (!defined CB_BIG_BUFFER || defined INSTANCE_BATCHING)
+#error "The default heap replaces the big buffer, instancing doesn't use constant buffers."
+#endif
+
+// Split the constants by how often they change: a per frame buffer written once per frame, per material constants that
+// live in the default heap and are only uploaded when a material changes, and the per object data on the path picked above.
+//#define CB_PARTITIONS
+#define NUM_MATERIALS 8
+// One of the materials changes every that many frames.
+#define CB_PARTITIONS_MATERIAL_CHANGE_FRAMES 60
+
+#if defined CB_PARTITIONS && defined INSTANCE_BATCHING
+#error "The partitions are bound next to the per object constant buffer, instancing doesn't use one."
+#endif
+
+// Hash the per object data every frame and let objects with identical data share the slot of the first one,
+// so only distinct payloads are written. The objects cycle through CB_DEDUP_DISTINCT_PAYLOADS different colors.
+//#define CB_DEDUP
+#define CB_DEDUP_DISTINCT_PAYLOADS (NUM_RENDER_OBJECTS / 4)
+
+#if defined CB_DEDUP && (!defined CB_BIG_BUFFER || defined CB_DEFAULT_HEAP || defined INSTANCE_BATCHING)
+#error "Deduplication packs the distinct payloads into the big buffer."
+#endif
+
+#if defined CB_DEDUP && (defined PARALLEL_UPDATE || defined FRAME_TASK_GRAPH || defined CB_BUNDLES)
+#error "Deduplication assigns the slots on a single update thread and the addresses change every frame."
+#endif
+
+#if defined PIPELINED_SIMULATION && (defined CB_DEFAULT_HEAP || defined CB_DEDUP)
+#error "The simulation moves every object, the default heap and deduplication measure scenes where most objects stay the same."
+#endif
+
+// Encode the per object data in 12 bytes instead of two float4s and decode it in the shaders. Half stores the position as
+// half floats, quantized as 16 bit snorm relative to the origin of the scene. Both store the color as 8 bit unorm.
+//#define CB_PAYLOAD_HALF
+//#define CB_PAYLOAD_QUANTIZED
+// How far the quantized positions can get from the bounds the scene starts with.
+#define CB_PAYLOAD_QUANTIZE_MARGIN 1.0f
+
+#if defined CB_PAYLOAD_HALF && defined CB_PAYLOAD_QUANTIZED
+#error "Pick one payload encoding."
+#endif
+
+#if defined CB_PAYLOAD_HALF || defined CB_PAYLOAD_QUANTIZED
+#define CB_PAYLOAD_COMPACT
+#endif
+
+#if defined CB_PAYLOAD_COMPACT && defined INSTANCE_BATCHING
+#error "The instanced shaders read the float layout."
+#endif
+
 const std::string D3D12App::name = "Constant Buffer Performance Test";
 const bool D3D12App::allow_fullscreen = false;
 const bool D3D12App::allow_resizing = false;
@@ -30,18 +270,24 @@ const std::uint8_t D3D12App::num_backbuffers = 3;
 const D3D_FEATURE_LEVEL D3D12App::feature_level = D3D_FEATURE_LEVEL_12_1;
 const D3D_ROOT_SIGNATURE_VERSION D3D12App::root_signature_version = D3D_ROOT_SIGNATURE_VERSION_1_1;
 
-struct Vertex
-{
-	Vertex(DirectX::XMFLOAT3 pos) : pos(pos) { }
+// What ends up in the constant buffers.
+#ifdef CB_PAYLOAD_COMPACT
+using CBPayload = PackedPayload;
+#else
+using CBPayload = CBPerObject;
+#endif
 
-	DirectX::XMFLOAT3 pos;
+#ifdef CB_PARTITIONS
+struct CBPerFrame
+{
+	DirectX::XMFLOAT4 tint;
 };
 
-struct CBPerObject
+struct CBPerMaterial
 {
-	DirectX::XMFLOAT4 pos;
 	DirectX::XMFLOAT4 color;
 };
+#endif
 
 static const std::array<Vertex, 4> vertices
 {
@@ -53,18 +299,44 @@ static const std::array<Vertex, 4> vertices
 
 struct ConstantBuffer
 {
-	std::array<D3D12_GPU_VIRTUAL_ADDRESS, D3D12App::num_backbuffers> gpu_addresses;
+	// One per frame in flight
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> gpu_addresses;
 
 #ifdef CB_BIG_BUFFER
 	size_t offset;
+#ifdef CB_DEFAULT_HEAP
+	std::uint32_t slot;
+	// One per frame in flight, each frame reads its own copy of the default heap buffer.
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> default_heap_addresses;
+#endif
+#ifdef CB_DEDUP
+	// Offset of the slot shared with identical payloads this frame.
+	size_t dedup_offset;
+#endif
 #else // CB_BIG_BUFFER
-	std::array<ComPtr<ID3D12Resource>, D3D12App::num_backbuffers> buffers;
+	std::vector<ComPtr<ID3D12Resource>> buffers;
 #ifdef CB_MAP_ON_CREATION
-	std::array<void*, D3D12App::num_backbuffers> addresses;
+	std::vector<void*> addresses;
 #endif // CB_MAP_ON_CREATION
 #endif // CB_BIG_BUFFER
 };
 
+// Per object state only the simulation thread touches.
+struct SimulatedObject
+{
+	DirectX::XMFLOAT4 start;
+	DirectX::XMFLOAT4 pos;
+	DirectX::XMFLOAT4 velocity;
+};
+
+// Immutable copy of the per object data handed from the simulation thread to the render thread.
+struct SceneSnapshot
+{
+	std::uint64_t tick = 0;
+	std::chrono::time_point<std::chrono::high_resolution_clock> published;
+	std::vector<CBPerObject> objects;
+};
+
 struct RenderObject
 {
 	DirectX::XMFLOAT4 pos;
@@ -72,13 +344,19 @@ struct RenderObject
 
 	D3D12_VERTEX_BUFFER_VIEW vb_view;
 	D3D12_INDEX_BUFFER_VIEW ib_view;
-	ConstantBuffer* const_buffer;
+	ConstantBuffer* const_buffer = nullptr;
+	std::uint32_t pipeline = 0;
+	std::uint32_t mesh = 0;
+	std::uint32_t material = 0;
+#ifdef FRAME_TASK_GRAPH
+	bool visible = true;
+#endif
 };
 
 class BufferPerfApp : public D3D12App
 {
 public:
-	BufferPerfApp();
+	explicit BufferPerfApp(std::uint32_t frames_in_flight);
 	~BufferPerfApp();
 
 	void Init() override;
@@ -88,11 +366,90 @@ public:
 private:
 	void CreateCommandList();
 	void CreateFences();
+	// (Re)creates everything that exists once per frame in flight.
+	void CreateFrameResources();
+	void SetFramesInFlight(std::uint32_t num);
+	void RetireConstantBuffer(ConstantBuffer* cb);
+#ifdef RESIDENCY_MANAGEMENT
+	void TrackResidency(ID3D12Resource* resource);
+	// Marks everything the frame that is about to be updated and recorded uses, before the budget is enforced.
+	void MarkFrameResidency();
+#endif
 	void CreateRootSignature();
 	void CreatePipelineStateObject();
-	void CreateVertexBuffer();
+	void CreateVertexBuffer(ID3D12GraphicsCommandList2* cmd_list);
 	void WaitForPrevFrame();
 	void UpdateFramerate();
+	void UpdateRange(std::size_t begin, std::size_t end);
+#ifdef PARALLEL_UPDATE
+	void ParallelUpdate(std::uint32_t num_threads);
+#endif
+	CommandRecorder* RecordPrePass();
+	void BindRenderTargets(CommandRecorder* list);
+	void RecordDrawState(CommandRecorder* list);
+	// The part of the draw state bundles record as well, everything but the viewport and scissor.
+	void RecordSharedDrawState(CommandRecorder* list);
+	void RecordDrawRange(CommandRecorder* list, std::size_t begin, std::size_t end);
+	void RecordObjectDraws(CommandRecorder* list, std::size_t begin, std::size_t end);
+	void RecordEndTransition(CommandRecorder* list);
+#ifdef DRAW_SORTING
+	void SortDraws();
+#endif
+#ifdef INSTANCE_BATCHING
+	void BuildInstanceBatches();
+	void RecordInstanceBatches(CommandRecorder* list);
+	void PerfOutput_Instancing();
+#endif
+#ifdef CB_BUNDLES
+	void RecordBundle();
+#endif
+#ifdef CB_DEFAULT_HEAP
+	struct UploadTotals;
+	UploadTotals& GetUploadTotals();
+	// Measures the last frame and moves the sweep along.
+	void BeginUploadFrame();
+	void FlushConstantUploads();
+	void PerfOutput_ConstantUploads();
+#endif
+#ifdef CB_PARTITIONS
+	void CreateFrameConstantBuffer();
+	void WriteFrameConstants();
+	// Changes a material every few frames and uploads the changed ones.
+	void FlushMaterials();
+	void PerfOutput_Partitions();
+#endif
+#ifdef CB_DEDUP
+	void PerfOutput_Dedup();
+#endif
+#ifdef CB_PAYLOAD_COMPACT
+	void EncodePayload(CBPerObject const & data, PackedPayload& payload) const;
+	void PerfOutput_Payload();
+#endif
+#ifdef SPLIT_SUBMISSION
+	// Returns the list of the last chunk, which is still open.
+	CommandRecorder* RecordSplitSubmission(CommandRecorder* list);
+	void PerfOutput_SplitSubmission();
+#endif
+#ifdef MT_RECORDING
+	void RecordWorkerChunk(std::uint32_t chunk_idx, std::size_t begin, std::size_t end);
+#endif
+	void SubmitFrame();
+#ifdef PIPELINED_SIMULATION
+	void SimulationLoop();
+	// Simulates and publishes one snapshot. Runs on whichever thread owns the simulation.
+	void SimulationTick();
+	void Simulate(float dt);
+	void CollectSnapshot(SceneSnapshot& snapshot);
+	void ConsumeSnapshot();
+#ifdef PIPELINED_SIMULATION_SWEEP
+	void SwitchSimulationThread();
+#endif
+	void PerfOutput_Pipeline();
+#endif
+#ifdef FRAME_TASK_GRAPH
+	void RunFrameGraph();
+	void CullRange(std::size_t begin, std::size_t end);
+#endif
 
 #ifdef CB_BIG_BUFFER
 	void CreateBigConstantBuffer(std::uint32_t size);
@@ -100,6 +457,12 @@ private:
 	void CreateConstantBuffer(ConstantBuffer** cb, std::uint32_t size);
 
 	void PerfOutput_Framerate();
+#ifdef PARALLEL_UPDATE_SWEEP
+	void PerfOutput_UpdateScaling();
+#endif
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	void PerfOutput_FramesInFlight();
+#endif
 
 	ComPtr<ID3D12Resource> depth_stencil_buffer;
 	ComPtr<ID3D12DescriptorHeap> depth_stencil_view_heap;
@@ -107,12 +470,48 @@ private:
 	std::array<ComPtr<ID3D12Resource>, num_backbuffers> render_targets;
 	ComPtr<ID3D12DescriptorHeap> render_target_view_heap;
 
-	std::array<ComPtr<ID3D12CommandAllocator>, num_backbuffers> cmd_allocators;
-	ComPtr<ID3D12GraphicsCommandList2> cmd_list;
+	std::unique_ptr<CommandListPool> direct_pool;
+	// Lists of the frame that is being recorded in submission order. The pre pass is always first.
+#ifdef MT_RECORDING
+	std::array<PooledCommandList*, NUM_RECORD_THREADS + 1> frame_lists;
+#else
+	std::array<PooledCommandList*, 1> frame_lists;
+#endif
+	JobSystem job_system;
+#ifdef FRAME_TASK_GRAPH
+	TaskGraph frame_graph;
+#endif
+
+#ifdef SPLIT_SUBMISSION
+	std::vector<PooledCommandList*> split_lists;
+	std::size_t split_draws = SPLIT_SUBMISSION_INITIAL_DRAWS;
+	std::uint64_t split_frames = 0;
+	std::uint64_t split_chunks = 0;
+	long double split_lead_sum = 0;
+#endif
+
+#ifdef CB_BUNDLES
+	std::unique_ptr<CommandListPool> bundle_pool;
+	std::vector<PooledCommandList*> bundles;
+	// Version of the draw list each bundle was recorded with.
+	std::vector<std::uint64_t> bundle_versions;
+#endif
+
+	std::unique_ptr<TimelineFence> fence;
+	std::unique_ptr<DeferredReleaseQueue> release_queue;
+	// Fence value signaled by the last frame that used each frame's resources.
+	std::vector<UINT64> frame_fence_values;
+#if defined CB_DEFAULT_HEAP || defined CB_PARTITIONS
+	// Fence value signaled by the last frame that read each copy of the uploaded constants.
+	// Unlike the frame fence values they survive a change of the frames in flight, the copies do as well.
+	std::array<UINT64, MAX_FRAMES_IN_FLIGHT> upload_read_values = {};
+#endif
+#ifdef RESIDENCY_MANAGEMENT
+	std::unique_ptr<ResidencyManager> residency;
+#endif
 
-	std::array<ComPtr<ID3D12Fence>, num_backbuffers> fences;
-	std::array<UINT64, num_backbuffers> fence_values;
-	HANDLE fence_event;
+	std::uint32_t frames_in_flight;
+	std::uint32_t frame_in_flight_idx = 0;
 
 	ComPtr<ID3D12RootSignature> root_signature;
 
@@ -127,21 +526,134 @@ private:
 	D3D12_INDEX_BUFFER_VIEW index_buffer_view;
 
 	ComPtr<ID3D12PipelineState> pipeline;
+#ifdef MULTI_STATE_WORKLOAD
+	// pipelines[0] is pipeline, the others only differ in their rasterizer state.
+	std::array<ComPtr<ID3D12PipelineState>, NUM_PIPELINES> pipelines;
+	std::array<D3D12_VERTEX_BUFFER_VIEW, NUM_MESHES> mesh_views;
+#endif
 	std::vector<D3D12_INPUT_ELEMENT_DESC> input_layout;
 
 	D3D12_VIEWPORT viewport;
 	D3D12_RECT scissor_rect;
 
 #ifdef CB_BIG_BUFFER
-	std::array<ComPtr<ID3D12Resource>, D3D12App::num_backbuffers> big_cb_buffers;
+	std::vector<ComPtr<ID3D12Resource>> big_cb_buffers;
 #ifdef CB_MAP_ON_CREATION
-	std::array<void*, D3D12App::num_backbuffers> big_cb_addresses;
+	std::vector<void*> big_cb_addresses;
 #endif // CB_MAP_ON_CREATION
 	size_t current_offset = 0;
 #endif
 
+#ifdef CB_DEFAULT_HEAP
+	std::unique_ptr<ConstantUploader> constant_uploader;
+#ifdef CB_DEFAULT_HEAP_SWEEP
+	// Otherwise the draws read the big buffer in the upload heap.
+	bool read_default_heap = false;
+	std::size_t changed_objects = 0;
+#else
+	bool read_default_heap = true;
+	std::size_t changed_objects = NUM_RENDER_OBJECTS * CB_DEFAULT_HEAP_CHANGED_PERCENT / 100;
+#endif
+	std::uint64_t upload_frame = 0;
+	std::uint64_t upload_config_frames = 0;
+	profiler::TimePoint prev_upload_frame;
+
+	struct UploadTotals
+	{
+		std::uint64_t frames = 0;
+		long double frame_time_sum = 0;
+		std::uint64_t flushes = 0;
+		UploadStats uploads;
+	};
+#ifdef CB_DEFAULT_HEAP_SWEEP
+	// Indexed by the step and read_default_heap.
+	std::array<std::array<UploadTotals, 2>, 100 / CB_DEFAULT_HEAP_SWEEP_STEP_PERCENT + 1> upload_sweep;
+	std::uint32_t upload_sweep_config = 0;
+#else
+	UploadTotals upload_totals;
+#endif
+#endif // CB_DEFAULT_HEAP
+
+#ifdef CB_PARTITIONS
+	// One 256 byte slot per frame in flight, mapped for the lifetime of the buffer.
+	ComPtr<ID3D12Resource> frame_cb_buffer;
+	std::uint8_t* frame_cb_address = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS frame_cb_gpu_address = 0;
+	std::array<CBPerMaterial, NUM_MATERIALS> materials;
+	std::unique_ptr<ConstantUploader> material_uploader;
+	std::uint64_t partition_frames = 0;
+	UploadStats material_uploads;
+	// Incremented by every recording thread.
+	std::atomic<std::uint64_t> material_binds{ 0 };
+	// Per object bytes written to upload memory, after the dedup and the payload packing. Incremented by every update thread.
+	std::atomic<std::uint64_t> object_bytes{ 0 };
+#endif
+
+#ifdef CB_DEDUP
+	std::unique_ptr<DedupTable> dedup;
+#endif
+
+#ifdef CB_MAP_RANGE_TRACKING
+	std::unique_ptr<MapRangeTracker> map_tracker;
+#endif
+
+#ifdef CB_PAYLOAD_QUANTIZED
+	// xyz is the center of the scene, w how far the positions can be from it.
+	DirectX::XMFLOAT4 payload_origin;
+#endif
+
+#ifdef PIPELINED_SIMULATION
+	TripleBuffer<SceneSnapshot> snapshots;
+	std::thread sim_thread;
+	std::atomic<bool> sim_running{ false };
+	std::mutex sim_mutex;
+	// Wakes the simulation thread when its snapshot was consumed or it has to stop, and the render thread when a tick is done.
+	std::condition_variable sim_wakeup;
+	// Guarded by sim_mutex.
+	bool sim_busy = false;
+	// Only written by the render thread, which runs the simulation itself while it is set.
+	bool sim_inline = false;
+
+	// Owned by the thread that simulates, handed over under sim_mutex.
+	std::vector<SimulatedObject> sim_objects;
+	std::uint64_t sim_ticks = 0;
+	long double sim_time = 0;
+	profiler::TimePoint sim_prev_tick;
+
+	// Render thread only.
+	std::uint64_t render_ticks = 0;
+	std::uint64_t fresh_snapshots = 0;
+	long double snapshot_age_sum = 0;
+#ifdef PIPELINED_SIMULATION_SWEEP
+	struct PipelineTotals
+	{
+		std::uint64_t frames = 0;
+		long double frame_time_sum = 0;
+	};
+	// Indexed by sim_inline.
+	std::array<PipelineTotals, 2> pipeline_sweep;
+	std::uint64_t pipeline_config_frames = 0;
+	profiler::TimePoint prev_pipeline_frame;
+#endif
+#endif
+
 	const float clear_color[4];
-	std::array<RenderObject, NUM_RENDER_OBJECTS> draw_list;
+	// Cache line aligned so the parallel update can partition it without false sharing.
+	alignas(64) std::array<RenderObject, NUM_RENDER_OBJECTS> draw_list;
+	// Bumped every time objects are added to or removed from the draw list.
+	std::uint64_t draw_list_version = 0;
+#ifdef DRAW_SORTING
+	// Recording order of the draw list.
+	DrawQueue draw_queue;
+#endif
+#ifdef INSTANCE_BATCHING
+	std::unique_ptr<InstanceBatcher> instance_batcher;
+	std::uint64_t instanced_frames = 0;
+	std::uint64_t instanced_batches = 0;
+#ifdef RESIDENCY_MANAGEMENT
+	std::size_t tracked_instance_pages = 0;
+#endif
+#endif
 
 	// profiling
 	std::uint32_t frames;
@@ -149,4 +661,23 @@ private:
 	std::chrono::time_point<std::chrono::high_resolution_clock> prev;
 
 	std::vector<std::uint32_t> captured_framerates;
+
+#ifdef FRAMES_IN_FLIGHT_SWEEP
+	struct DepthStats
+	{
+		std::uint64_t frames = 0;
+		long double frame_time_sum = 0;
+		std::uint64_t latency_samples = 0;
+		long double latency_sum = 0;
+	};
+
+	std::uint64_t sweep_frame = 0;
+	std::array<DepthStats, MAX_FRAMES_IN_FLIGHT> depth_stats;
+	std::vector<profiler::TimePoint> frame_start_times;
+	std::vector<bool> frame_submitted;
+	profiler::TimePoint prev_frame_start;
+#endif
+#ifdef PARALLEL_UPDATE_SWEEP
+	std::uint32_t update_sweep_frame = 0;
+#endif
 };
\ No newline at end of file
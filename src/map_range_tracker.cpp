@@ -0,0 +1,114 @@
+#include "map_range_tracker.hpp"
+
+#include "api_interposer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+MapRangeTracker::MapRangeTracker(std::size_t merge_gap)
+	: merge_gap(merge_gap)
+{
+}
+
+void MapRangeTracker::Write(ID3D12Resource* resource, std::size_t offset, void const * data, std::size_t size)
+{
+	std::uint8_t* address;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& mapping = mappings[resource];
+		if (!mapping.address)
+		{
+			// Nothing is read back.
+			D3D12_RANGE read_range = { 0, 0 };
+			void* mapped;
+			HRESULT hr = interposer::Map(resource, 0, &read_range, &mapped);
+			if (FAILED(hr))
+			{
+				throw "Failed to map constant buffer";
+			}
+			mapping.address = static_cast<std::uint8_t*>(mapped);
+			num_maps++;
+		}
+
+		mapping.ranges.push_back({ offset, offset + size });
+		num_writes++;
+		written_bytes += size;
+		address = mapping.address;
+	}
+
+	// The buffer stays mapped until UnmapAll, the copy doesn't need the lock.
+	std::memcpy(address + offset, data, size);
+}
+
+void MapRangeTracker::UnmapAll()
+{
+	num_frames++;
+
+	for (auto it = mappings.begin(); it != mappings.end();)
+	{
+		auto resource = it->first;
+		auto& mapping = it->second;
+		if (!mapping.address)
+		{
+			it = mappings.erase(it);
+			continue;
+		}
+
+		std::sort(mapping.ranges.begin(), mapping.ranges.end(), [](D3D12_RANGE const & a, D3D12_RANGE const & b) { return a.Begin < b.Begin; });
+		merged.clear();
+		for (auto const & range : mapping.ranges)
+		{
+			if (!merged.empty() && range.Begin <= merged.back().End + merge_gap)
+				merged.back().End = (std::max)(merged.back().End, range.End);
+			else
+				merged.push_back(range);
+		}
+
+		// The first write mapped the buffer once, every further range needs a map to balance its unmap.
+		D3D12_RANGE read_range = { 0, 0 };
+		for (std::size_t i = 1; i < merged.size(); i++)
+		{
+			void* mapped;
+			HRESULT hr = interposer::Map(resource, 0, &read_range, &mapped);
+			if (FAILED(hr))
+			{
+				throw "Failed to map constant buffer";
+			}
+			num_maps++;
+		}
+
+		for (auto const & range : merged)
+		{
+			interposer::Unmap(resource, 0, &range);
+			num_unmaps++;
+			reported_bytes += range.End - range.Begin;
+		}
+
+		mapping.address = nullptr;
+		mapping.ranges.clear();
+		++it;
+	}
+}
+
+std::size_t MapRangeTracker::GetNumTracked() const
+{
+	return mappings.size();
+}
+
+void MapRangeTracker::PrintStats(std::string const & path) const
+{
+	std::ofstream file;
+	file.open(path);
+
+	long double frames = (std::max)(num_frames, std::uint64_t(1));
+
+	file << "Map range tracking:\n";
+	file << "\tWrites per frame: " << num_writes / frames << '\n';
+	file << "\tMaps per frame: " << num_maps / frames << '\n';
+	file << "\tUnmaps per frame: " << num_unmaps / frames << '\n';
+	file << "\tWritten: " << written_bytes / frames << " bytes per frame\n";
+	file << "\tReported as written: " << reported_bytes / frames << " bytes per frame\n";
+
+	file.close();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <d3d12.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Maps upload heap buffers on their first write of a frame and unmaps them once per frame with the ranges that were written.
+// Unmap takes a single written range, so a buffer with several disjoint ranges is mapped again once for every extra range.
+// Map is reference counted, the extra maps return the same pointer and every range gets an Unmap of its own.
+class MapRangeTracker
+{
+public:
+	// Ranges at most merge_gap bytes apart are reported as one, so writing part of every slot doesn't end up as a range per slot.
+	explicit MapRangeTracker(std::size_t merge_gap);
+
+	MapRangeTracker(MapRangeTracker const &) = delete;
+	MapRangeTracker& operator=(MapRangeTracker const &) = delete;
+
+	// Copies size bytes to offset, mapping the buffer first if this is its first write since the last UnmapAll. Thread safe.
+	void Write(ID3D12Resource* resource, std::size_t offset, void const * data, std::size_t size);
+	// Unmaps every buffer written since the last call. Call once per frame before submitting, not while writing.
+	void UnmapAll();
+
+	// Buffers written since the second to last UnmapAll, the others have been dropped.
+	std::size_t GetNumTracked() const;
+	void PrintStats(std::string const & path) const;
+
+private:
+	struct Mapping
+	{
+		// Null while the buffer isn't mapped.
+		std::uint8_t* address = nullptr;
+		std::vector<D3D12_RANGE> ranges;
+	};
+
+	std::size_t merge_gap;
+
+	std::mutex mutex;
+	// Buffers that weren't written during a frame are dropped, so retired ones don't pile up.
+	std::unordered_map<ID3D12Resource*, Mapping> mappings;
+	std::vector<D3D12_RANGE> merged;
+
+	std::uint64_t num_frames = 0;
+	std::uint64_t num_writes = 0;
+	std::uint64_t num_maps = 0;
+	std::uint64_t num_unmaps = 0;
+	std::uint64_t written_bytes = 0;
+	std::uint64_t reported_bytes = 0;
+};
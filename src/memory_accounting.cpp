@@ -0,0 +1,84 @@
+#include "memory_accounting.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+namespace memory {
+
+	std::array<Stats, static_cast<std::size_t>(Category::Count)> stats;
+	std::mutex mutex;
+
+	static char const * GetCategoryName(std::size_t category)
+	{
+		static const std::array<char const *, static_cast<std::size_t>(Category::Count)> names = {
+			"Constant data", "Geometry", "Staging", "Descriptors", "Command allocators"
+		};
+		return names[category];
+	}
+
+	std::uint64_t GetAllocatedSize(ID3D12Device* device, ID3D12Resource* resource)
+	{
+		auto desc = resource->GetDesc();
+		return device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+	}
+
+	void Allocate(Category category, std::uint64_t used, std::uint64_t allocated)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& s = stats[static_cast<std::size_t>(category)];
+
+		s.allocations++;
+		s.used += used;
+		s.allocated += allocated;
+		s.peak_allocations = (std::max)(s.peak_allocations, s.allocations);
+		s.peak_allocated = (std::max)(s.peak_allocated, s.allocated);
+	}
+
+	void Free(Category category, std::uint64_t used, std::uint64_t allocated)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& s = stats[static_cast<std::size_t>(category)];
+
+		s.allocations--;
+		s.used -= used;
+		s.allocated -= allocated;
+	}
+
+	void PrintResults(std::string const & path, std::string const & strategy)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::ofstream file;
+		file.open(path);
+
+		file << "Memory (" << strategy << "):\n";
+
+		Stats total;
+		for (std::size_t i = 0; i < stats.size(); i++)
+		{
+			auto const & s = stats[i];
+			total.allocations += s.allocations;
+			total.used += s.used;
+			total.allocated += s.allocated;
+			total.peak_allocated += s.peak_allocated;
+
+			// Waste ratio is the part of the live allocation that is padding.
+			auto padding = s.allocated - s.used;
+			file << '\t' << GetCategoryName(i) << ":\n";
+			file << "\t\tLive allocations: " << s.allocations << " (peak " << s.peak_allocations << ")\n";
+			file << "\t\tLive: " << s.allocated << " bytes\n";
+			file << "\t\tPeak: " << s.peak_allocated << " bytes\n";
+			file << "\t\tUsed: " << s.used << " bytes\n";
+			file << "\t\tPadding: " << padding << " bytes\n";
+			file << "\t\tWaste ratio: " << (s.allocated ? (long double)padding / s.allocated : 0) << '\n';
+		}
+
+		// The peaks of the categories don't have to coincide, so the total peak is an upper bound.
+		file << "\tTotal live: " << total.allocated << " bytes in " << total.allocations << " allocations\n";
+		file << "\tTotal peak (upper bound): " << total.peak_allocated << " bytes\n";
+		file << "\tTotal waste ratio: " << (total.allocated ? (long double)(total.allocated - total.used) / total.allocated : 0) << '\n';
+
+		file.close();
+	}
+
+}
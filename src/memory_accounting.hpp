@@ -0,0 +1,47 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace memory
+{
+
+	enum class Category
+	{
+		ConstantData,
+		Geometry,
+		Staging,
+		Descriptors,
+		CommandAllocators,
+		Count
+	};
+
+	struct Stats
+	{
+		std::uint64_t allocations = 0;
+		std::uint64_t peak_allocations = 0;
+		// Bytes the application actually uses.
+		std::uint64_t used = 0;
+		// Bytes the driver reserved, including alignment padding.
+		std::uint64_t allocated = 0;
+		std::uint64_t peak_allocated = 0;
+	};
+
+	extern std::array<Stats, static_cast<std::size_t>(Category::Count)> stats;
+	extern std::mutex mutex;
+
+	// Size the driver reserves for a resource, committed resources are at least 64KB aligned.
+	std::uint64_t GetAllocatedSize(ID3D12Device* device, ID3D12Resource* resource);
+
+	// Thread safe, resources can be freed on the deferred release thread.
+	void Allocate(Category category, std::uint64_t used, std::uint64_t allocated);
+	void Free(Category category, std::uint64_t used, std::uint64_t allocated);
+
+	// strategy describes the configuration the numbers belong to.
+	void PrintResults(std::string const & path, std::string const & strategy);
+
+} /* memory */
@@ -0,0 +1,137 @@
+#include "payload_packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// MSVC enables F16C together with AVX2, GCC and Clang need it separately. PAYLOAD_PACKING_AVX2 in CMake sets both.
+#if defined __AVX2__ && (defined _MSC_VER || defined __F16C__)
+#include <immintrin.h>
+#define PAYLOAD_SIMD
+#endif
+
+// Rounds to nearest even and handles denormals, infinity and NaN the same way as _mm_cvtps_ph.
+static std::uint16_t FloatToHalf(float value)
+{
+	constexpr std::uint32_t f32_infinity = 255u << 23;
+	constexpr std::uint32_t f16_max = (127u + 16) << 23;
+	constexpr std::uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	std::uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	std::uint32_t half;
+	if (bits >= f16_max)
+	{
+		// NaNs stay quiet NaNs and keep the top of their payload.
+		half = bits > f32_infinity ? 0x7e00 | ((bits >> 13) & 0x3ff) : 0x7c00;
+	}
+	else if (bits < (113u << 23))
+	{
+		// Too small for a normal half, let the float addition do the rounding of the denormal.
+		float magic;
+		std::memcpy(&magic, &denorm_magic, sizeof(magic));
+		float shifted;
+		std::memcpy(&shifted, &bits, sizeof(shifted));
+		shifted += magic;
+		std::memcpy(&half, &shifted, sizeof(half));
+		half -= denorm_magic;
+	}
+	else
+	{
+		std::uint32_t odd = (bits >> 13) & 1;
+		bits += ((15u - 127) << 23) + 0xfff + odd;
+		half = bits >> 13;
+	}
+
+	return static_cast<std::uint16_t>(half | (sign >> 16));
+}
+
+// Clamps with NaN in the second operand of max, so NaN becomes lo just like with _mm_max_ps(x, lo).
+static float Clamp(float x, float lo, float hi)
+{
+	return (std::min)((std::max)(lo, x), hi);
+}
+
+static std::uint32_t PackColorScalar(float const * color)
+{
+	std::uint32_t packed = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		packed |= static_cast<std::uint32_t>(std::lrint(Clamp(color[i], 0.0f, 1.0f) * 255.0f)) << (i * 8);
+	}
+	return packed;
+}
+
+void PackHalfScalar(float const * pos, float const * color, PackedPayload& out)
+{
+	out.pos[0] = FloatToHalf(pos[0]) | (std::uint32_t(FloatToHalf(pos[1])) << 16);
+	out.pos[1] = FloatToHalf(pos[2]) | (std::uint32_t(FloatToHalf(pos[3])) << 16);
+	out.color = PackColorScalar(color);
+}
+
+void PackQuantizedScalar(float const * pos, float const * color, float const * origin, float extent, PackedPayload& out)
+{
+	float scale = 32767.0f / extent;
+	std::uint32_t values[3];
+	for (int i = 0; i < 3; i++)
+	{
+		float relative = Clamp((pos[i] - origin[i]) * scale, -32767.0f, 32767.0f);
+		values[i] = static_cast<std::uint16_t>(static_cast<std::int16_t>(std::lrint(relative)));
+	}
+	out.pos[0] = values[0] | (values[1] << 16);
+	out.pos[1] = values[2];
+	out.color = PackColorScalar(color);
+}
+
+#ifdef PAYLOAD_SIMD
+static std::uint32_t PackColor(float const * color)
+{
+	__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(color), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	__m128i values = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(255.0f)));
+	values = _mm_packus_epi32(values, values);
+	values = _mm_packus_epi16(values, values);
+	return static_cast<std::uint32_t>(_mm_cvtsi128_si32(values));
+}
+
+void PackHalf(float const * pos, float const * color, PackedPayload& out)
+{
+	__m128i halves = _mm_cvtps_ph(_mm_loadu_ps(pos), _MM_FROUND_TO_NEAREST_INT);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(out.pos), halves);
+	out.color = PackColor(color);
+}
+
+void PackQuantized(float const * pos, float const * color, float const * origin, float extent, PackedPayload& out)
+{
+	float scale = 32767.0f / extent;
+	// w isn't stored, whatever ends up in its lane is masked off.
+	__m128 relative = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pos), _mm_loadu_ps(origin)), _mm_set1_ps(scale));
+	__m128i values = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(relative, _mm_set1_ps(-32767.0f)), _mm_set1_ps(32767.0f)));
+	values = _mm_packs_epi32(values, values);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(out.pos), values);
+	out.pos[1] &= 0xffff;
+	out.color = PackColor(color);
+}
+
+bool IsPackingVectorized()
+{
+	return true;
+}
+#else
+void PackHalf(float const * pos, float const * color, PackedPayload& out)
+{
+	PackHalfScalar(pos, color, out);
+}
+
+void PackQuantized(float const * pos, float const * color, float const * origin, float extent, PackedPayload& out)
+{
+	PackQuantizedScalar(pos, color, origin, extent, out);
+}
+
+bool IsPackingVectorized()
+{
+	return false;
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// Per object data in 12 bytes instead of two float4s. cb_vertex.hlsl and cb_pixel.hlsl decode it.
+struct PackedPayload
+{
+	// Half: x | y << 16 and z | w << 16. Quantized: x | y << 16 and z, as 16 bit snorm.
+	std::uint32_t pos[2];
+	// 8 bit unorm rgba, red in the lowest byte.
+	std::uint32_t color;
+};
+
+// pos and color are 4 floats each. Both packers use SSE4.1 and F16C when compiled for AVX2, scalar code otherwise.
+void PackHalf(float const * pos, float const * color, PackedPayload& out);
+// Stores pos - origin in units of extent / 32767, so positions within extent of the origin keep 16 bits of precision.
+void PackQuantized(float const * pos, float const * color, float const * origin, float extent, PackedPayload& out);
+
+// Always compiled, the packers above produce the same bits with or without SIMD.
+void PackHalfScalar(float const * pos, float const * color, PackedPayload& out);
+void PackQuantizedScalar(float const * pos, float const * color, float const * origin, float extent, PackedPayload& out);
+// Whether PackHalf and PackQuantized were compiled with SIMD.
+bool IsPackingVectorized();
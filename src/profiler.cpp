@@ -2,6 +2,6 @@
 
 namespace profiler {
 
-	std::map<std::string, Result> profiler::cpu_results;
+	std::map<std::string, Result> cpu_results;
 
 }
\ No newline at end of file
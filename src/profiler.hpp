@@ -41,11 +41,11 @@ namespace profiler
 		cpu_results[name].end.push_back(Now());
 	}
 
-	static void PrintResult(std::string name)
+	static Precision GetAverage(std::string name)
 	{
 		auto it = cpu_results.find(name);
 		if (it == cpu_results.end())
-			throw "Can't print a result that doesn't exist";
+			throw "Can't average a result that doesn't exist";
 
 		Precision sum = 0;
 		unsigned int num_results = it->second.end.size();
@@ -53,7 +53,17 @@ namespace profiler
 			Duration diff = it->second.end[i] - it->second.start[i];
 			sum += diff.count();
 		}
-		Precision average = (Precision)sum / (Precision)num_results;
+		return (Precision)sum / (Precision)num_results;
+	}
+
+	static void PrintResult(std::string name)
+	{
+		auto it = cpu_results.find(name);
+		if (it == cpu_results.end())
+			throw "Can't print a result that doesn't exist";
+
+		unsigned int num_results = it->second.end.size();
+		Precision average = GetAverage(name);
 
 		std::ofstream file;
 		file.open("perf_" + name + ".txt");
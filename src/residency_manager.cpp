@@ -0,0 +1,167 @@
+#include "residency_manager.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+ResidencyManager::ResidencyManager(std::unique_ptr<ResidencyDevice> device, UINT64 local_budget_override, UINT64 non_local_budget_override)
+	: device(std::move(device)),
+	budget_overrides{ local_budget_override, non_local_budget_override },
+	num_evictions(0),
+	num_evict_calls(0),
+	num_made_resident(0),
+	num_make_resident_calls(0)
+{
+	// Without a budget everything would be evicted every frame, so fail here instead of in the first frame.
+	for (std::size_t i = 0; i < num_segments; i++)
+		GetBudget(static_cast<MemorySegment>(i));
+}
+
+void ResidencyManager::Track(ID3D12Pageable* object, UINT64 size, MemorySegment segment)
+{
+	lru.push_back({ object, size, segment, 0, true });
+	lookup[object] = std::prev(lru.end());
+
+	auto& resident = resident_bytes[static_cast<std::size_t>(segment)];
+	resident += size;
+	auto& peak = peak_resident_bytes[static_cast<std::size_t>(segment)];
+	peak = (std::max)(peak, resident);
+}
+
+void ResidencyManager::Untrack(ID3D12Pageable* object)
+{
+	auto it = lookup.find(object);
+	if (it == lookup.end())
+		return;
+
+	if (it->second->resident)
+		resident_bytes[static_cast<std::size_t>(it->second->segment)] -= it->second->size;
+
+	// It might be released before the next MakeUsedResident.
+	to_make_resident.erase(std::remove(to_make_resident.begin(), to_make_resident.end(), object), to_make_resident.end());
+
+	lru.erase(it->second);
+	lookup.erase(it);
+}
+
+void ResidencyManager::MarkUsed(ID3D12Pageable* object, UINT64 fence_value)
+{
+	auto it = lookup.find(object);
+	if (it == lookup.end())
+		return;
+
+	auto entry = it->second;
+	entry->last_used = fence_value;
+	if (!entry->resident)
+	{
+		entry->resident = true;
+		resident_bytes[static_cast<std::size_t>(entry->segment)] += entry->size;
+		to_make_resident.push_back(entry->object);
+	}
+
+	// Most recently used goes to the back.
+	lru.splice(lru.end(), lru, entry);
+}
+
+void ResidencyManager::MakeUsedResident()
+{
+	if (to_make_resident.empty())
+		return;
+
+	HRESULT hr = device->MakeResident(static_cast<UINT>(to_make_resident.size()), to_make_resident.data());
+	if (FAILED(hr))
+	{
+		throw "Failed to make resources resident";
+	}
+
+	num_made_resident += to_make_resident.size();
+	num_make_resident_calls++;
+	to_make_resident.clear();
+
+	for (std::size_t i = 0; i < num_segments; i++)
+		peak_resident_bytes[i] = (std::max)(peak_resident_bytes[i], resident_bytes[i]);
+}
+
+void ResidencyManager::EnforceBudget(UINT64 completed_fence_value)
+{
+	std::array<UINT64, num_segments> budgets;
+	std::size_t num_over_budget = 0;
+	for (std::size_t i = 0; i < num_segments; i++)
+	{
+		budgets[i] = GetBudget(static_cast<MemorySegment>(i));
+		if (resident_bytes[i] > budgets[i])
+			num_over_budget++;
+	}
+	if (num_over_budget == 0)
+		return;
+
+	// One pass for all segments, so they still share a single Evict call.
+	std::vector<ID3D12Pageable*> to_evict;
+	for (auto& entry : lru)
+	{
+		// Everything after this one has been used more recently, so it isn't done either.
+		if (num_over_budget == 0 || entry.last_used > completed_fence_value)
+			break;
+
+		auto segment = static_cast<std::size_t>(entry.segment);
+		if (!entry.resident || resident_bytes[segment] <= budgets[segment])
+			continue;
+
+		entry.resident = false;
+		resident_bytes[segment] -= entry.size;
+		to_evict.push_back(entry.object);
+		if (resident_bytes[segment] <= budgets[segment])
+			num_over_budget--;
+	}
+
+	if (to_evict.empty())
+		return;
+
+	HRESULT hr = device->Evict(static_cast<UINT>(to_evict.size()), to_evict.data());
+	if (FAILED(hr))
+	{
+		throw "Failed to evict resources";
+	}
+
+	num_evictions += to_evict.size();
+	num_evict_calls++;
+}
+
+UINT64 ResidencyManager::GetBudget(MemorySegment segment)
+{
+	auto budget_override = budget_overrides[static_cast<std::size_t>(segment)];
+	if (budget_override != 0)
+		return budget_override;
+
+	UINT64 budget;
+	HRESULT hr = device->QueryBudget(segment, budget);
+	if (FAILED(hr))
+	{
+		throw "Failed to query the video memory budget";
+	}
+
+	return budget;
+}
+
+UINT64 ResidencyManager::GetResidentBytes(MemorySegment segment) const
+{
+	return resident_bytes[static_cast<std::size_t>(segment)];
+}
+
+void ResidencyManager::PrintStats(std::string const & path) const
+{
+	std::ofstream file;
+	file.open(path);
+
+	file << "Residency:\n";
+	file << "\tTracked objects: " << lru.size() << '\n';
+	std::array<char const *, num_segments> names = { "local", "non-local" };
+	for (std::size_t i = 0; i < num_segments; i++)
+	{
+		file << "\tResident in " << names[i] << " memory: " << resident_bytes[i] << " bytes, peak " << peak_resident_bytes[i] << " bytes\n";
+	}
+	file << "\tEvicted: " << num_evictions << " objects in " << num_evict_calls << " calls\n";
+	file << "\tMade resident: " << num_made_resident << " objects in " << num_make_resident_calls << " calls\n";
+
+	file.close();
+}
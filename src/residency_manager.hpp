@@ -0,0 +1,87 @@
+#pragma once
+
+#include <d3d12.h>
+
+#include <array>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory segment group an object lives in. Every one of them has a budget of its own.
+enum class MemorySegment
+{
+	Local, // Video memory on discrete adapters, all memory on UMA adapters.
+	NonLocal, // System memory the GPU reads over the bus, upload and readback heaps on discrete adapters.
+	Count
+};
+
+// The device calls the residency manager makes, so the policy can be tested without a device.
+class ResidencyDevice
+{
+public:
+	virtual ~ResidencyDevice() = default;
+
+	virtual HRESULT MakeResident(UINT num_objects, ID3D12Pageable* const * objects) = 0;
+	virtual HRESULT Evict(UINT num_objects, ID3D12Pageable* const * objects) = 0;
+	// Memory of the segment the OS lets the application use.
+	virtual HRESULT QueryBudget(MemorySegment segment, UINT64& budget) = 0;
+};
+
+// Keeps the tracked heaps and committed resources within the budget of their memory segment by evicting the least recently used ones.
+// Only objects whose last use has completed on the GPU are evicted. Evicted objects are made resident again when they are used.
+class ResidencyManager
+{
+public:
+	// A budget of 0 uses the budget the device reports for the segment, construction throws if it can't report one.
+	ResidencyManager(std::unique_ptr<ResidencyDevice> device, UINT64 local_budget_override = 0, UINT64 non_local_budget_override = 0);
+
+	ResidencyManager(ResidencyManager const &) = delete;
+	ResidencyManager& operator=(ResidencyManager const &) = delete;
+
+	// Newly created objects are resident.
+	void Track(ID3D12Pageable* object, UINT64 size, MemorySegment segment);
+	void Untrack(ID3D12Pageable* object);
+
+	// Marks an object as used by the submission that signals fence_value.
+	void MarkUsed(ID3D12Pageable* object, UINT64 fence_value);
+	// Makes every object that was marked as used but is evicted resident again, in a single call. Call before submitting.
+	void MakeUsedResident();
+	// Evicts least recently used objects in a single call until the resident size of every segment fits in its budget.
+	// Call once per frame outside of recording.
+	void EnforceBudget(UINT64 completed_fence_value);
+
+	UINT64 GetBudget(MemorySegment segment);
+	UINT64 GetResidentBytes(MemorySegment segment) const;
+
+	void PrintStats(std::string const & path) const;
+
+private:
+	static constexpr std::size_t num_segments = static_cast<std::size_t>(MemorySegment::Count);
+
+	struct Entry
+	{
+		ID3D12Pageable* object;
+		UINT64 size;
+		MemorySegment segment;
+		UINT64 last_used;
+		bool resident;
+	};
+
+	std::unique_ptr<ResidencyDevice> device;
+	std::array<UINT64, num_segments> budget_overrides;
+
+	// Front is the least recently used object.
+	std::list<Entry> lru;
+	std::unordered_map<ID3D12Pageable*, std::list<Entry>::iterator> lookup;
+	std::vector<ID3D12Pageable*> to_make_resident;
+	std::array<UINT64, num_segments> resident_bytes = {};
+
+	// Statistics
+	std::array<UINT64, num_segments> peak_resident_bytes = {};
+	std::uint64_t num_evictions;
+	std::uint64_t num_evict_calls;
+	std::uint64_t num_made_resident;
+	std::uint64_t num_make_resident_calls;
+};
@@ -0,0 +1,43 @@
+#include "scatter_records.hpp"
+
+#include <cstring>
+
+std::uint32_t GetRecordStride(std::uint32_t payload_size)
+{
+	return (sizeof(std::uint32_t) + payload_size + 3) & ~3u;
+}
+
+std::uint32_t WriteRecords(std::uint8_t const * shadow, std::uint8_t* dirty, std::uint8_t dirty_bit, std::uint32_t num_slots, std::uint32_t slot_size,
+	std::uint32_t payload_size, std::uint32_t& slot, std::uint32_t count, std::uint8_t* records)
+{
+	std::uint32_t record_stride = GetRecordStride(payload_size);
+	std::uint32_t padding = record_stride - sizeof(std::uint32_t) - payload_size;
+
+	std::uint32_t written = 0;
+	for (; written < count && slot < num_slots; slot++)
+	{
+		if (!(dirty[slot] & dirty_bit))
+			continue;
+
+		auto record = records + (std::size_t)written++ * record_stride;
+		std::memcpy(record, &slot, sizeof(slot));
+		std::memcpy(record + sizeof(slot), shadow + (std::size_t)slot * slot_size, payload_size);
+		// The shader stores whole dwords, so the padding ends up in the slot as well.
+		std::memset(record + sizeof(slot) + payload_size, 0, padding);
+		dirty[slot] &= ~dirty_bit;
+	}
+
+	return written;
+}
+
+void ScatterRecords(std::uint8_t const * records, std::uint32_t count, std::uint32_t record_stride, std::uint32_t payload_size, std::uint8_t* slots, std::uint32_t slot_size)
+{
+	std::uint32_t stored_size = (payload_size + 3) & ~3u;
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		auto record = records + (std::size_t)i * record_stride;
+		std::uint32_t slot;
+		std::memcpy(&slot, record, sizeof(slot));
+		std::memcpy(slots + (std::size_t)slot * slot_size, record + sizeof(slot), stored_size);
+	}
+}
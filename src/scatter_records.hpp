@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Compact (slot index, payload) records as staged by the delta scatter. Every record is the slot index followed by the payload,
+// padded to a multiple of 4 bytes for the byte address loads of scatter_compute.hlsl.
+
+// Size of a record with a payload of payload_size bytes.
+std::uint32_t GetRecordStride(std::uint32_t payload_size);
+
+// Writes up to count records for the slots that have dirty_bit set, starting the search at slot and clearing the bit.
+// slot is left behind the last slot written, so a run that doesn't fit at once continues where the last call stopped.
+// Returns the number of records written.
+std::uint32_t WriteRecords(std::uint8_t const * shadow, std::uint8_t* dirty, std::uint8_t dirty_bit, std::uint32_t num_slots, std::uint32_t slot_size,
+	std::uint32_t payload_size, std::uint32_t& slot, std::uint32_t count, std::uint8_t* records);
+
+// Applies records to a buffer of slots the same way the scatter shader does, padding included.
+void ScatterRecords(std::uint8_t const * records, std::uint32_t count, std::uint32_t record_stride, std::uint32_t payload_size, std::uint8_t* slots, std::uint32_t slot_size);
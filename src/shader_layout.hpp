@@ -0,0 +1,26 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <cstddef>
+
+// Structs the shaders read. Kept apart from main.hpp so the layout can be checked without a device.
+
+struct Vertex
+{
+	Vertex(DirectX::XMFLOAT3 pos) : pos(pos) { }
+
+	DirectX::XMFLOAT3 pos;
+};
+
+struct CBPerObject
+{
+	DirectX::XMFLOAT4 pos;
+	DirectX::XMFLOAT4 color;
+};
+
+// pulling_vertex.hlsl gets the strides and offsets as macros but loads the values with Load3 and Load4,
+// which only works for tightly packed 32 bit values at 4 byte aligned offsets.
+static_assert(sizeof(Vertex) == 3 * sizeof(float), "Vertex has to be a tightly packed float3");
+static_assert(sizeof(CBPerObject) == 8 * sizeof(float), "CBPerObject has to be two tightly packed float4s");
+static_assert(offsetof(CBPerObject, color) % 4 == 0, "Byte address buffer loads have to be 4 byte aligned");
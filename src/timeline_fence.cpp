@@ -0,0 +1,156 @@
+#include "timeline_fence.hpp"
+
+#include <map>
+
+TimelineFence::TimelineFence(ComPtr<ID3D12Device> device, std::uint32_t spin_threshold_us, std::wstring name)
+	: last_signaled(0),
+	last_completed(0),
+	spin_threshold_us(spin_threshold_us)
+{
+	HRESULT hr = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
+	if (FAILED(hr))
+	{
+		throw "Failed to create fence.";
+	}
+	fence->SetName(name.c_str());
+
+	event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (event == nullptr)
+	{
+		throw "Failed to create fence event.";
+	}
+}
+
+TimelineFence::~TimelineFence()
+{
+	CloseHandle(event);
+}
+
+UINT64 TimelineFence::Signal(ID3D12CommandQueue* queue)
+{
+	HRESULT hr = queue->Signal(fence.Get(), last_signaled + 1);
+	if (FAILED(hr))
+	{
+		throw "Failed to set fence signal.";
+	}
+
+	return ++last_signaled;
+}
+
+UINT64 TimelineFence::GetNextValue() const
+{
+	return last_signaled + 1;
+}
+
+UINT64 TimelineFence::GetLastSignaledValue() const
+{
+	return last_signaled;
+}
+
+bool TimelineFence::IsCompleted(UINT64 value)
+{
+	// Only ask the fence when the cached value isn't enough, GetCompletedValue isn't free.
+	if (value > last_completed)
+	{
+		last_completed = fence->GetCompletedValue();
+	}
+
+	return value <= last_completed;
+}
+
+UINT64 TimelineFence::GetCompletedValue()
+{
+	last_completed = fence->GetCompletedValue();
+	return last_completed;
+}
+
+void TimelineFence::Wait(UINT64 value, char const * cause)
+{
+	if (IsCompleted(value))
+	{
+		return;
+	}
+
+	auto start = profiler::Now();
+	bool slept = false;
+
+	// Waking up from an event can take longer than the GPU needs to finish, so spin first.
+	while (!IsCompleted(value))
+	{
+		profiler::Duration waited = profiler::Now() - start;
+		if (waited.count() * 1000 >= spin_threshold_us)
+		{
+			HRESULT hr = fence->SetEventOnCompletion(value, event);
+			if (FAILED(hr))
+			{
+				throw "Failed to set fence event.";
+			}
+
+			WaitForSingleObject(event, INFINITE);
+			slept = true;
+			break;
+		}
+
+		YieldProcessor();
+	}
+
+	last_completed = (std::max)(last_completed, value);
+	stalls.push_back({ cause, profiler::Duration(profiler::Now() - start).count(), slept });
+}
+
+void TimelineFence::Flush(char const * cause)
+{
+	Wait(last_signaled, cause);
+}
+
+ID3D12Fence* TimelineFence::Get() const
+{
+	return fence.Get();
+}
+
+std::vector<FenceStall> const & TimelineFence::GetStalls() const
+{
+	return stalls;
+}
+
+void TimelineFence::PrintStalls(std::string const & path) const
+{
+	struct Summary
+	{
+		std::size_t count = 0;
+		std::size_t slept = 0;
+		profiler::Precision total = 0;
+		profiler::Precision max = 0;
+	};
+
+	std::map<std::string, Summary> summaries;
+	for (auto const & stall : stalls)
+	{
+		auto& summary = summaries[stall.cause];
+		summary.count++;
+		summary.slept += stall.slept ? 1 : 0;
+		summary.total += stall.duration;
+		summary.max = (std::max)(summary.max, stall.duration);
+	}
+
+	std::ofstream file;
+	file.open(path);
+
+	file << "Fence stalls (spin threshold " << spin_threshold_us << "us):\n";
+	for (auto const & summary : summaries)
+	{
+		file << '\t' << summary.first << ":\n";
+		file << "\t\tStalls: " << summary.second.count << " (" << summary.second.slept << " slept)\n";
+		file << "\t\tTotal: " << summary.second.total << "ms\n";
+		file << "\t\tAverage: " << summary.second.total / summary.second.count << "ms\n";
+		file << "\t\tMax: " << summary.second.max << "ms\n";
+	}
+
+	file << "Every stall (cause, ms, slept):\n";
+	for (auto const & stall : stalls)
+	{
+		file << stall.cause << ", " << stall.duration << ", " << stall.slept << '\n';
+	}
+
+	file.close();
+}
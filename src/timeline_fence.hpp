@@ -0,0 +1,53 @@
+#pragma once
+
+#include "d3d12_app.hpp"
+#include "profiler.hpp"
+
+#include <vector>
+
+struct FenceStall
+{
+	char const * cause;
+	profiler::Precision duration; // ms
+	bool slept; // False if the spin was enough
+};
+
+// A single monotonically increasing fence per queue. Every signal gets a new value,
+// waiting for any older value is waiting for everything submitted before it.
+class TimelineFence
+{
+public:
+	TimelineFence(ComPtr<ID3D12Device> device, std::uint32_t spin_threshold_us, std::wstring name = L"Timeline Fence");
+	~TimelineFence();
+
+	TimelineFence(TimelineFence const &) = delete;
+	TimelineFence& operator=(TimelineFence const &) = delete;
+
+	// Signals the next value on the queue and returns it.
+	UINT64 Signal(ID3D12CommandQueue* queue);
+
+	// Value the next call to Signal will use.
+	UINT64 GetNextValue() const;
+	UINT64 GetLastSignaledValue() const;
+	bool IsCompleted(UINT64 value);
+	UINT64 GetCompletedValue();
+
+	// Spins for up to the spin threshold before going to sleep on an event. Every wait on an incomplete value is recorded as a stall.
+	void Wait(UINT64 value, char const * cause);
+	// Waits for everything that has been signaled so far.
+	void Flush(char const * cause);
+
+	ID3D12Fence* Get() const;
+
+	std::vector<FenceStall> const & GetStalls() const;
+	void PrintStalls(std::string const & path) const;
+
+private:
+	ComPtr<ID3D12Fence> fence;
+	HANDLE event;
+	UINT64 last_signaled;
+	UINT64 last_completed;
+	std::uint32_t spin_threshold_us;
+
+	std::vector<FenceStall> stalls;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock free single producer single consumer handoff. The producer always has a buffer to write to
+// and the consumer always reads the newest published buffer, neither of them ever waits on the other.
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : shared(2), write_idx(0), read_idx(1) {}
+
+	std::array<T, 3>& GetBuffers() { return buffers; }
+
+	// Producer
+	T& GetWriteBuffer() { return buffers[write_idx]; }
+
+	void Publish()
+	{
+		std::uint8_t prev = shared.exchange(static_cast<std::uint8_t>(write_idx | dirty_bit), std::memory_order_acq_rel);
+		write_idx = prev & index_mask;
+	}
+
+	// True as long as the consumer didn't pick up the last published buffer.
+	bool HasUnconsumed() const
+	{
+		return shared.load(std::memory_order_acquire) & dirty_bit;
+	}
+
+	// Consumer
+	// Swaps in the newest published buffer. Returns false and keeps the current one if nothing new was published.
+	bool Acquire()
+	{
+		if (!(shared.load(std::memory_order_acquire) & dirty_bit))
+			return false;
+
+		std::uint8_t prev = shared.exchange(read_idx, std::memory_order_acq_rel);
+		read_idx = prev & index_mask;
+		return true;
+	}
+
+	T const & GetReadBuffer() const { return buffers[read_idx]; }
+
+private:
+	static constexpr std::uint8_t index_mask = 0x3;
+	static constexpr std::uint8_t dirty_bit = 0x4;
+
+	std::array<T, 3> buffers;
+	std::atomic<std::uint8_t> shared;
+	std::uint8_t write_idx; // Only touched by the producer
+	std::uint8_t read_idx; // Only touched by the consumer
+};
@@ -0,0 +1,92 @@
+#include "recording_command_list.hpp"
+#include "test.hpp"
+
+#include <fstream>
+#include <sstream>
+
+// Built with API_INTERPOSER. Runs the wrapped calls over fake objects and checks that they are forwarded and counted.
+
+class FakeDevice : public ID3D12Device
+{
+public:
+	HRESULT CreateCommittedResource(D3D12_HEAP_PROPERTIES const *, D3D12_HEAP_FLAGS, D3D12_RESOURCE_DESC const *, D3D12_RESOURCE_STATES,
+		D3D12_CLEAR_VALUE const *, REFIID, void** resource) override
+	{
+		*resource = this;
+		return S_OK;
+	}
+
+	HRESULT CreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_DESC const *, REFIID, void**) override { return E_FAIL; }
+	HRESULT CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE, REFIID, void**) override { return S_OK; }
+	HRESULT CreateCommandList(UINT, D3D12_COMMAND_LIST_TYPE, ID3D12CommandAllocator*, ID3D12PipelineState*, REFIID, void**) override { return S_OK; }
+};
+
+class FakeResource : public ID3D12Resource
+{
+public:
+	HRESULT Map(UINT, D3D12_RANGE const *, void** data) override
+	{
+		*data = memory;
+		return S_OK;
+	}
+	void Unmap(UINT, D3D12_RANGE const *) override {}
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override { return 0x10000; }
+
+	char memory[256];
+};
+
+static std::uint64_t GetCount(interposer::Call call)
+{
+	return interposer::GetThreadStats()[static_cast<std::size_t>(call)].count.load();
+}
+
+int main()
+{
+	FakeDevice device;
+	IID iid = {};
+
+	// Results are passed through untouched.
+	void* resource = nullptr;
+	CHECK(interposer::CreateCommittedResource(&device, nullptr, D3D12_HEAP_FLAG_NONE, nullptr, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, iid, &resource) == S_OK);
+	CHECK(resource == &device);
+	CHECK(FAILED(interposer::CreateDescriptorHeap(&device, nullptr, iid, nullptr)));
+	for (int i = 0; i < 3; i++)
+		CHECK(interposer::CreateCommandAllocator(&device, D3D12_COMMAND_LIST_TYPE_DIRECT, iid, nullptr) == S_OK);
+	CHECK(interposer::CreateCommandList(&device, 0, D3D12_COMMAND_LIST_TYPE_DIRECT, nullptr, nullptr, iid, nullptr) == S_OK);
+
+	CHECK(GetCount(interposer::Call::CreateCommittedResource) == 1);
+	CHECK(GetCount(interposer::Call::CreateDescriptorHeap) == 1);
+	CHECK(GetCount(interposer::Call::CreateCommandAllocator) == 3);
+	CHECK(GetCount(interposer::Call::CreateCommandList) == 1);
+
+	FakeResource buffer;
+	void* address = nullptr;
+	D3D12_RANGE read_range = { 0, 0 };
+	CHECK(interposer::Map(&buffer, 0, &read_range, &address) == S_OK);
+	CHECK(address == buffer.memory);
+	interposer::Unmap(&buffer, 0, nullptr);
+	CHECK(interposer::GetGPUVirtualAddress(&buffer) == 0x10000);
+	CHECK(GetCount(interposer::Call::Map) == 1);
+	CHECK(GetCount(interposer::Call::Unmap) == 1);
+	CHECK(GetCount(interposer::Call::GetGPUVirtualAddress) == 1);
+
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.DrawInstanced(4, 1, 0, 0);
+	list.DrawInstanced(4, 1, 0, 0);
+	list.Close();
+	CHECK(mock.Count(interposer::Call::DrawInstanced) == 2);
+	CHECK(GetCount(interposer::Call::DrawInstanced) == 2);
+	CHECK(GetCount(interposer::Call::Close) == 1);
+
+	// Only called methods show up in the table.
+	interposer::PrintResults("api_interposer_test.txt");
+	std::ifstream file("api_interposer_test.txt");
+	std::stringstream table;
+	table << file.rdbuf();
+	CHECK(table.str().find("CreateCommandAllocator:\n\t\tCalls: 3\n") != std::string::npos);
+	CHECK(table.str().find("DrawInstanced:\n\t\tCalls: 2\n") != std::string::npos);
+	CHECK(table.str().find("ExecuteBundle") == std::string::npos);
+
+	return EXIT_SUCCESS;
+}
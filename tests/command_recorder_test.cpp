@@ -0,0 +1,150 @@
+#include "recording_command_list.hpp"
+#include "test.hpp"
+
+// Built with STATE_FILTERING. Checks which state the recorder still considers bound after the calls that invalidate it.
+
+static ID3D12PipelineState pipeline_a;
+static ID3D12PipelineState pipeline_b;
+static ID3D12RootSignature root_signature_a;
+static ID3D12RootSignature root_signature_b;
+static RecordingCommandList bundle_list;
+static D3D12_VIEWPORT viewport = { 0, 0, 1280, 720, 0, 1 };
+static D3D12_RECT scissor_rect = { 0, 0, 1280, 720 };
+static D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view = { 0x1000, 64, 16 };
+
+static void BindEverything(CommandRecorder& list)
+{
+	list.SetPipelineState(&pipeline_a);
+	list.SetGraphicsRootSignature(&root_signature_a);
+	list.SetGraphicsRootConstantBufferView(0, 0x10000);
+	list.SetGraphicsRootShaderResourceView(1, 0x20000);
+	list.SetGraphicsRoot32BitConstant(2, 7, 0);
+	list.RSSetViewports(1, &viewport);
+	list.RSSetScissorRects(1, &scissor_rect);
+	list.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	list.IASetVertexBuffers(0, 1, &vertex_buffer_view);
+}
+
+static void TestRedundantCallsAreFiltered()
+{
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline_a);
+
+	BindEverything(list);
+	// Reset already bound the pipeline.
+	CHECK(mock.Count(interposer::Call::SetPipelineState) == 0);
+	auto num_commands = mock.commands.size();
+	CHECK(num_commands == 8);
+
+	BindEverything(list);
+	CHECK(mock.commands.size() == num_commands);
+
+	// Only the first constant of a parameter is tracked, other offsets always go through.
+	list.SetGraphicsRoot32BitConstant(2, 7, 1);
+	list.SetGraphicsRoot32BitConstant(2, 7, 1);
+	CHECK(mock.Count(interposer::Call::SetGraphicsRoot32BitConstant) == 3);
+
+	// A different value isn't redundant.
+	list.SetGraphicsRootConstantBufferView(0, 0x10100);
+	list.SetPipelineState(&pipeline_b);
+	CHECK(mock.Count(interposer::Call::SetGraphicsRootConstantBufferView) == 2);
+	CHECK(mock.Count(interposer::Call::SetPipelineState) == 1);
+}
+
+static void TestRootSignatureChangeInvalidatesRootArguments()
+{
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline_a);
+	BindEverything(list);
+	mock.Clear();
+
+	list.SetGraphicsRootSignature(&root_signature_b);
+	list.SetGraphicsRootConstantBufferView(0, 0x10000);
+	list.SetGraphicsRootShaderResourceView(1, 0x20000);
+	list.SetGraphicsRoot32BitConstant(2, 7, 0);
+	CHECK(mock.commands.size() == 4);
+
+	// The rest of the state doesn't depend on the root signature.
+	list.SetPipelineState(&pipeline_a);
+	list.RSSetViewports(1, &viewport);
+	list.RSSetScissorRects(1, &scissor_rect);
+	list.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	list.IASetVertexBuffers(0, 1, &vertex_buffer_view);
+	CHECK(mock.commands.size() == 4);
+
+	// Setting the same root signature again keeps the arguments.
+	list.SetGraphicsRootSignature(&root_signature_b);
+	list.SetGraphicsRootConstantBufferView(0, 0x10000);
+	CHECK(mock.commands.size() == 4);
+}
+
+static void TestExecuteBundleInvalidatesInheritedState()
+{
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline_a);
+	BindEverything(list);
+
+	list.ExecuteBundle(&bundle_list);
+	CHECK(mock.commands.back().call == interposer::Call::ExecuteBundle);
+	CHECK(mock.commands.back().value == (std::uintptr_t)&bundle_list);
+	mock.Clear();
+
+	// The bundle has to use the same root signature and can't change viewports or scissors, so those stay bound.
+	list.SetGraphicsRootSignature(&root_signature_a);
+	list.RSSetViewports(1, &viewport);
+	list.RSSetScissorRects(1, &scissor_rect);
+	CHECK(mock.commands.empty());
+
+	// Everything else might have been changed by the bundle.
+	list.SetPipelineState(&pipeline_a);
+	list.SetGraphicsRootConstantBufferView(0, 0x10000);
+	list.SetGraphicsRootShaderResourceView(1, 0x20000);
+	list.SetGraphicsRoot32BitConstant(2, 7, 0);
+	list.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	list.IASetVertexBuffers(0, 1, &vertex_buffer_view);
+	CHECK(mock.commands.size() == 6);
+}
+
+static void TestResetKeepsOnlyThePipeline()
+{
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline_a);
+	BindEverything(list);
+	mock.Clear();
+
+	list.Reset(&pipeline_b);
+	list.SetPipelineState(&pipeline_b);
+	CHECK(mock.commands.empty());
+
+	BindEverything(list);
+	CHECK(mock.commands.size() == 9);
+}
+
+static void TestFilteredCallsAreCounted()
+{
+	auto& stats = interposer::GetThreadStats()[static_cast<std::size_t>(interposer::Call::IASetPrimitiveTopology)];
+	auto filtered = stats.filtered.load();
+
+	RecordingCommandList mock;
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline_a);
+	for (int i = 0; i < 5; i++)
+		list.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+	CHECK(mock.Count(interposer::Call::IASetPrimitiveTopology) == 1);
+	CHECK(stats.filtered.load() == filtered + 4);
+}
+
+int main()
+{
+	TestRedundantCallsAreFiltered();
+	TestRootSignatureChangeInvalidatesRootArguments();
+	TestExecuteBundleInvalidatesInheritedState();
+	TestResetKeepsOnlyThePipeline();
+	TestFilteredCallsAreCounted();
+	return EXIT_SUCCESS;
+}
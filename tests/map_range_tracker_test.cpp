@@ -0,0 +1,170 @@
+#include "map_range_tracker.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Writes through the tracker into buffers that keep their memory on the CPU and record every Map and Unmap.
+
+class FakeBuffer : public ID3D12Resource
+{
+public:
+	explicit FakeBuffer(std::size_t size) : memory(size, 0) {}
+
+	HRESULT Map(UINT, D3D12_RANGE const *, void** data) override
+	{
+		map_count++;
+		maps++;
+		*data = memory.data();
+		return S_OK;
+	}
+
+	void Unmap(UINT, D3D12_RANGE const * written_range) override
+	{
+		map_count--;
+		unmapped.push_back(*written_range);
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override
+	{
+		return 0;
+	}
+
+	std::vector<std::uint8_t> memory;
+	// Outstanding maps, Map is reference counted.
+	int map_count = 0;
+	int maps = 0;
+	std::vector<D3D12_RANGE> unmapped;
+};
+
+static bool RangeIs(D3D12_RANGE const & range, SIZE_T begin, SIZE_T end)
+{
+	return range.Begin == begin && range.End == end;
+}
+
+static void WriteSlot(MapRangeTracker& tracker, FakeBuffer& buffer, std::uint32_t slot)
+{
+	std::uint8_t payload[32];
+	std::memset(payload, static_cast<int>(slot + 1), sizeof(payload));
+	tracker.Write(&buffer, slot * 256, payload, sizeof(payload));
+}
+
+// Ranges come in out of order and are reported sorted, neighbours within the gap as one.
+static void TestSortAndMerge()
+{
+	FakeBuffer buffer(64 * 256);
+	MapRangeTracker tracker(256);
+
+	WriteSlot(tracker, buffer, 50);
+	for (std::uint32_t slot = 10; slot-- > 0;)
+		WriteSlot(tracker, buffer, slot);
+	CHECK(buffer.maps == 1);
+
+	tracker.UnmapAll();
+	CHECK(buffer.unmapped.size() == 2);
+	CHECK(RangeIs(buffer.unmapped[0], 0, 9 * 256 + 32));
+	CHECK(RangeIs(buffer.unmapped[1], 50 * 256, 50 * 256 + 32));
+	// The second range needed a map of its own.
+	CHECK(buffer.maps == 2);
+	CHECK(buffer.map_count == 0);
+
+	for (std::uint32_t slot : { 0u, 9u, 50u })
+	{
+		CHECK(buffer.memory[slot * 256] == slot + 1);
+		CHECK(buffer.memory[slot * 256 + 31] == slot + 1);
+		CHECK(buffer.memory[slot * 256 + 32] == 0);
+	}
+}
+
+static void TestMergeGap()
+{
+	FakeBuffer buffer(1024);
+	MapRangeTracker tracker(0);
+
+	std::uint8_t data[64] = {};
+	// Touching and overlapping ranges are merged even without a gap, the others aren't.
+	tracker.Write(&buffer, 0, data, 16);
+	tracker.Write(&buffer, 16, data, 16);
+	tracker.Write(&buffer, 8, data, 40);
+	tracker.Write(&buffer, 49, data, 1);
+	tracker.Write(&buffer, 100, data, 4);
+	tracker.Write(&buffer, 100, data, 2);
+	tracker.UnmapAll();
+
+	CHECK(buffer.unmapped.size() == 3);
+	CHECK(RangeIs(buffer.unmapped[0], 0, 48));
+	CHECK(RangeIs(buffer.unmapped[1], 49, 50));
+	CHECK(RangeIs(buffer.unmapped[2], 100, 104));
+	CHECK(buffer.maps == 3);
+	CHECK(buffer.map_count == 0);
+}
+
+static void TestThreadedWrites()
+{
+	constexpr std::uint32_t num_threads = 4, slots_per_thread = 16;
+	FakeBuffer shared(num_threads * slots_per_thread * 256);
+	std::vector<FakeBuffer> own(num_threads, FakeBuffer(256));
+	MapRangeTracker tracker(0);
+
+	for (int frame = 0; frame < 3; frame++)
+	{
+		// Every thread writes every other slot of its part of the shared buffer and one buffer of its own.
+		std::vector<std::thread> threads;
+		for (std::uint32_t t = 0; t < num_threads; t++)
+		{
+			threads.emplace_back([&, t]
+			{
+				for (std::uint32_t i = 0; i < slots_per_thread; i += 2)
+					WriteSlot(tracker, shared, t * slots_per_thread + i);
+				WriteSlot(tracker, own[t], 0);
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		shared.unmapped.clear();
+		tracker.UnmapAll();
+		CHECK(shared.map_count == 0);
+		CHECK(shared.unmapped.size() == num_threads * slots_per_thread / 2);
+		for (std::size_t i = 0; i < shared.unmapped.size(); i++)
+			CHECK(RangeIs(shared.unmapped[i], i * 512, i * 512 + 32));
+		for (auto& buffer : own)
+			CHECK(buffer.map_count == 0);
+	}
+
+	for (std::uint32_t slot = 0; slot < num_threads * slots_per_thread; slot++)
+		CHECK(shared.memory[slot * 256] == (slot % 2 ? 0 : slot + 1));
+}
+
+// Buffers that weren't written for a frame are forgotten, the ones still in use are mapped again on their next write.
+static void TestDropUnwritten()
+{
+	FakeBuffer a(256), b(256);
+	MapRangeTracker tracker(0);
+
+	WriteSlot(tracker, a, 0);
+	WriteSlot(tracker, b, 0);
+	tracker.UnmapAll();
+	CHECK(tracker.GetNumTracked() == 2);
+
+	WriteSlot(tracker, a, 0);
+	tracker.UnmapAll();
+	CHECK(tracker.GetNumTracked() == 1);
+	CHECK(a.maps == 2 && a.map_count == 0);
+	// Nothing was written, so b isn't unmapped again either.
+	CHECK(b.maps == 1 && b.unmapped.size() == 1 && b.map_count == 0);
+
+	tracker.UnmapAll();
+	CHECK(tracker.GetNumTracked() == 0);
+	CHECK(a.unmapped.size() == 2);
+}
+
+int main()
+{
+	TestSortAndMerge();
+	TestMergeGap();
+	TestThreadedWrites();
+	TestDropUnwritten();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// The storage types of DirectXMath.h, the host tests only need their layout.
+
+namespace DirectX
+{
+	struct XMFLOAT3
+	{
+		float x, y, z;
+
+		XMFLOAT3() = default;
+		constexpr XMFLOAT3(float x, float y, float z) : x(x), y(y), z(z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x, y, z, w;
+
+		XMFLOAT4() = default;
+		constexpr XMFLOAT4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	};
+}
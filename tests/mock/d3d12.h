@@ -0,0 +1,166 @@
+#pragma once
+
+// The subset of d3d12.h the host tests compile against. Only the types and methods the tested code uses are declared,
+// the interfaces are plain abstract classes the tests implement.
+
+#include <cstddef>
+#include <cstdint>
+
+using HRESULT = std::int32_t;
+using BOOL = int;
+using INT = std::int32_t;
+using UINT = std::uint32_t;
+using UINT8 = std::uint8_t;
+using UINT64 = std::uint64_t;
+using LONG = std::int32_t;
+using FLOAT = float;
+using SIZE_T = std::size_t;
+
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+using D3D12_GPU_VIRTUAL_ADDRESS = UINT64;
+
+struct IID
+{
+	std::uint64_t data[2];
+};
+using REFIID = IID const &;
+
+struct D3D12_RANGE
+{
+	SIZE_T Begin;
+	SIZE_T End;
+};
+
+struct D3D12_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+};
+
+struct D3D12_RECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+};
+
+struct D3D12_VERTEX_BUFFER_VIEW
+{
+	D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+	UINT SizeInBytes;
+	UINT StrideInBytes;
+};
+
+struct D3D12_CPU_DESCRIPTOR_HANDLE
+{
+	SIZE_T ptr;
+};
+
+// Only passed through, the tests never look inside.
+struct D3D12_RESOURCE_BARRIER;
+struct D3D12_HEAP_PROPERTIES;
+struct D3D12_RESOURCE_DESC;
+struct D3D12_CLEAR_VALUE;
+struct D3D12_DESCRIPTOR_HEAP_DESC;
+
+enum D3D12_HEAP_FLAGS
+{
+	D3D12_HEAP_FLAG_NONE = 0
+};
+
+enum D3D12_RESOURCE_STATES
+{
+	D3D12_RESOURCE_STATE_COMMON = 0,
+	D3D12_RESOURCE_STATE_GENERIC_READ = 0xac3
+};
+
+enum D3D12_COMMAND_LIST_TYPE
+{
+	D3D12_COMMAND_LIST_TYPE_DIRECT = 0,
+	D3D12_COMMAND_LIST_TYPE_BUNDLE = 1,
+	D3D12_COMMAND_LIST_TYPE_COMPUTE = 2,
+	D3D12_COMMAND_LIST_TYPE_COPY = 3
+};
+
+enum D3D12_CLEAR_FLAGS
+{
+	D3D12_CLEAR_FLAG_DEPTH = 0x1,
+	D3D12_CLEAR_FLAG_STENCIL = 0x2
+};
+
+enum D3D_PRIMITIVE_TOPOLOGY
+{
+	D3D_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5
+};
+using D3D12_PRIMITIVE_TOPOLOGY = D3D_PRIMITIVE_TOPOLOGY;
+
+struct ID3D12PipelineState {};
+struct ID3D12RootSignature {};
+struct ID3D12CommandAllocator {};
+
+struct ID3D12Pageable
+{
+	virtual ~ID3D12Pageable() = default;
+};
+
+struct ID3D12Resource : ID3D12Pageable
+{
+	virtual HRESULT Map(UINT subresource, D3D12_RANGE const * read_range, void** data) = 0;
+	virtual void Unmap(UINT subresource, D3D12_RANGE const * written_range) = 0;
+	virtual D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() = 0;
+};
+
+struct ID3D12CommandList
+{
+	virtual ~ID3D12CommandList() = default;
+};
+
+struct ID3D12GraphicsCommandList : ID3D12CommandList
+{
+	virtual HRESULT Close() = 0;
+	virtual void DrawInstanced(UINT vertex_count, UINT instance_count, UINT start_vertex, UINT start_instance) = 0;
+	virtual void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void RSSetViewports(UINT num, D3D12_VIEWPORT const * viewports) = 0;
+	virtual void RSSetScissorRects(UINT num, D3D12_RECT const * rects) = 0;
+	virtual void SetPipelineState(ID3D12PipelineState* pso) = 0;
+	virtual void ResourceBarrier(UINT num, D3D12_RESOURCE_BARRIER const * barriers) = 0;
+	virtual void ExecuteBundle(ID3D12GraphicsCommandList* bundle) = 0;
+	virtual void SetGraphicsRootSignature(ID3D12RootSignature* root_signature) = 0;
+	virtual void SetGraphicsRoot32BitConstant(UINT idx, UINT value, UINT offset) = 0;
+	virtual void SetGraphicsRootConstantBufferView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+	virtual void SetGraphicsRootShaderResourceView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+	virtual void IASetVertexBuffers(UINT start_slot, UINT num, D3D12_VERTEX_BUFFER_VIEW const * views) = 0;
+	virtual void OMSetRenderTargets(UINT num, D3D12_CPU_DESCRIPTOR_HANDLE const * rtvs, BOOL single_handle, D3D12_CPU_DESCRIPTOR_HANDLE const * dsv) = 0;
+	virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE dsv, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil, UINT num_rects, D3D12_RECT const * rects) = 0;
+	virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE rtv, FLOAT const color[4], UINT num_rects, D3D12_RECT const * rects) = 0;
+};
+
+struct ID3D12GraphicsCommandList2 : ID3D12GraphicsCommandList {};
+
+struct ID3D12CommandQueue
+{
+	virtual ~ID3D12CommandQueue() = default;
+	virtual void ExecuteCommandLists(UINT num_lists, ID3D12CommandList* const * lists) = 0;
+};
+
+struct ID3D12Device
+{
+	virtual ~ID3D12Device() = default;
+	virtual HRESULT CreateCommittedResource(D3D12_HEAP_PROPERTIES const * heap_properties, D3D12_HEAP_FLAGS heap_flags, D3D12_RESOURCE_DESC const * desc,
+		D3D12_RESOURCE_STATES initial_state, D3D12_CLEAR_VALUE const * clear_value, REFIID riid, void** resource) = 0;
+	virtual HRESULT CreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_DESC const * desc, REFIID riid, void** heap) = 0;
+	virtual HRESULT CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type, REFIID riid, void** allocator) = 0;
+	virtual HRESULT CreateCommandList(UINT node_mask, D3D12_COMMAND_LIST_TYPE type, ID3D12CommandAllocator* allocator, ID3D12PipelineState* pso,
+		REFIID riid, void** list) = 0;
+};
@@ -0,0 +1,100 @@
+#include "job_system.hpp"
+#include "recording_command_list.hpp"
+#include "test.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Records the draws the way MT_RECORDING does: every chunk of the draw list into its own command list, with the state set up again
+// in every list. Checks that submitting the lists in chunk order reproduces the draw sequence and prints how the record time scales.
+
+static constexpr std::size_t num_draws = 50000;
+static constexpr std::uint32_t max_threads = 8;
+static constexpr int num_frames = 20;
+static constexpr D3D12_GPU_VIRTUAL_ADDRESS cb_base = 0x10000;
+
+static ID3D12PipelineState pipeline;
+static ID3D12RootSignature root_signature;
+static D3D12_VIEWPORT viewport = { 0, 0, 1280, 720, 0, 1 };
+static D3D12_RECT scissor_rect = { 0, 0, 1280, 720 };
+static D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view = { 0x1000, 64, 16 };
+
+static void RecordWorkerChunk(RecordingCommandList& mock, std::size_t begin, std::size_t end)
+{
+	mock.Clear();
+	CommandRecorder list(&mock);
+	list.Reset(&pipeline);
+
+	list.SetGraphicsRootSignature(&root_signature);
+	list.RSSetViewports(1, &viewport);
+	list.RSSetScissorRects(1, &scissor_rect);
+	list.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	list.IASetVertexBuffers(0, 1, &vertex_buffer_view);
+
+	for (auto i = begin; i < end; i++)
+	{
+		list.SetGraphicsRootConstantBufferView(0, cb_base + i * 256);
+		list.DrawInstanced(4, 1, 0, 0);
+	}
+
+	list.Close();
+}
+
+static void CheckSubmission(std::vector<RecordingCommandList> const & lists)
+{
+	std::size_t next_draw = 0;
+	for (auto const & list : lists)
+	{
+		CHECK(list.closed);
+		CHECK(list.commands.size() >= 6);
+		CHECK(list.commands[0].call == interposer::Call::SetGraphicsRootSignature);
+		CHECK(list.commands[1].call == interposer::Call::RSSetViewports);
+		CHECK(list.commands[2].call == interposer::Call::RSSetScissorRects);
+		CHECK(list.commands[3].call == interposer::Call::IASetPrimitiveTopology);
+		CHECK(list.commands[4].call == interposer::Call::IASetVertexBuffers);
+
+		for (auto const & command : list.commands)
+		{
+			if (command.call != interposer::Call::SetGraphicsRootConstantBufferView)
+				continue;
+			CHECK(command.value == cb_base + next_draw * 256);
+			next_draw++;
+		}
+		CHECK(list.Count(interposer::Call::DrawInstanced) == list.Count(interposer::Call::SetGraphicsRootConstantBufferView));
+	}
+	CHECK(next_draw == num_draws);
+}
+
+int main()
+{
+	long double single_thread_ms = 0;
+
+	std::cout << "Recording " << num_draws << " draws into recording command lists:\n";
+	for (std::uint32_t num_threads = 1; num_threads <= max_threads; num_threads++)
+	{
+		// The calling thread records as well.
+		JobSystem job_system(num_threads - 1);
+		std::vector<RecordingCommandList> lists(num_threads);
+
+		long double total_ms = 0;
+		for (int frame = 0; frame < num_frames; frame++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			job_system.ParallelFor(num_draws, num_threads, [&lists](std::size_t begin, std::size_t end, std::uint32_t chunk_idx)
+			{
+				RecordWorkerChunk(lists[chunk_idx], begin, end);
+			});
+			total_ms += std::chrono::duration<long double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			CheckSubmission(lists);
+		}
+
+		long double average_ms = total_ms / num_frames;
+		if (num_threads == 1)
+			single_thread_ms = average_ms;
+		std::cout << '\t' << num_threads << " threads: " << average_ms << "ms, " << single_thread_ms / average_ms << "x\n";
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+#include "payload_packing.hpp"
+#include "test.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <random>
+
+// Packs with the CPU encoders and decodes the way cb_vertex.hlsl and cb_pixel.hlsl do, then checks the error bounds.
+
+static float HalfToFloat(std::uint32_t half)
+{
+	std::uint32_t sign = (half & 0x8000) << 16;
+	std::uint32_t exponent = (half >> 10) & 0x1f;
+	std::uint32_t mantissa = half & 0x3ff;
+
+	float value;
+	if (exponent == 0)
+		value = std::ldexp((float)mantissa, -24);
+	else if (exponent == 31)
+		value = mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+	else
+		value = std::ldexp((float)(mantissa | 0x400), (int)exponent - 25);
+
+	return sign ? -value : value;
+}
+
+// f16tof32 of the lower and upper halves.
+static void DecodeHalf(PackedPayload const & payload, float* pos)
+{
+	pos[0] = HalfToFloat(payload.pos[0] & 0xffff);
+	pos[1] = HalfToFloat(payload.pos[0] >> 16);
+	pos[2] = HalfToFloat(payload.pos[1] & 0xffff);
+	pos[3] = HalfToFloat(payload.pos[1] >> 16);
+}
+
+static void DecodeQuantized(PackedPayload const & payload, float const * origin, float extent, float* pos)
+{
+	std::int16_t quantized[3] = { (std::int16_t)(payload.pos[0] & 0xffff), (std::int16_t)(payload.pos[0] >> 16), (std::int16_t)(payload.pos[1] & 0xffff) };
+	for (int i = 0; i < 3; i++)
+		pos[i] = origin[i] + quantized[i] * (extent / 32767.0f);
+}
+
+static void DecodeColor(PackedPayload const & payload, float* color)
+{
+	for (int i = 0; i < 4; i++)
+		color[i] = ((payload.color >> (i * 8)) & 0xff) / 255.0f;
+}
+
+static void TestLayout()
+{
+	float pos[4] = { 1.0f, -2.0f, 0.5f, 1.0f };
+	float color[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	PackedPayload payload;
+	PackHalf(pos, color, payload);
+
+	// x | y << 16 and z | w << 16, red in the lowest byte.
+	CHECK(payload.pos[0] == (0x3c00u | (0xc000u << 16)));
+	CHECK(payload.pos[1] == (0x3800u | (0x3c00u << 16)));
+	CHECK(payload.color == 0xff0000ffu);
+
+	float origin[4] = { 0, 0, 0, 0 };
+	float quantized_pos[4] = { 1.0f, -1.0f, 0.0f, 123.0f };
+	PackQuantized(quantized_pos, color, origin, 1.0f, payload);
+	CHECK(payload.pos[0] == (0x7fffu | (0x8001u << 16)));
+	// w isn't stored.
+	CHECK(payload.pos[1] == 0);
+}
+
+static void TestHalfRoundTrip()
+{
+	float color[4] = {};
+	PackedPayload payload;
+	float decoded[4];
+
+	// Values a half can represent come back exactly.
+	float exact[][4] = { { 0.0f, -0.0f, 1.0f, -1.0f }, { 0.5f, 1024.0f, 65504.0f, -65504.0f }, { 0.099975586f, 3.140625f, -0.33325195f, 6.1035156e-05f } };
+	for (auto const & pos : exact)
+	{
+		PackHalf(pos, color, payload);
+		DecodeHalf(payload, decoded);
+		CHECK(std::memcmp(pos, decoded, sizeof(decoded)) == 0);
+	}
+
+	// Everything else is off by at most half a unit in the last place, 2^-11 relative for normals and 2^-25 absolute for denormals.
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> mantissa(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> exponent(-26, 15);
+	for (int i = 0; i < 100000; i++)
+	{
+		float pos[4];
+		for (auto& value : pos)
+			value = std::ldexp(mantissa(rng), exponent(rng));
+
+		PackHalf(pos, color, payload);
+		DecodeHalf(payload, decoded);
+		for (int j = 0; j < 4; j++)
+		{
+			float bound = (std::max)(std::fabs(pos[j]) * std::ldexp(1.0f, -11), std::ldexp(1.0f, -25));
+			CHECK(std::fabs(decoded[j] - pos[j]) <= bound);
+		}
+	}
+}
+
+static void TestHalfOutOfRange()
+{
+	float color[4] = {};
+	PackedPayload payload;
+	float decoded[4];
+
+	// Up to half a unit above the largest half rounds down to it, anything above becomes infinity.
+	float inf = std::numeric_limits<float>::infinity();
+	float pos[4] = { 65519.0f, 65520.0f, -1e9f, inf };
+	PackHalf(pos, color, payload);
+	DecodeHalf(payload, decoded);
+	CHECK(decoded[0] == 65504.0f);
+	CHECK(decoded[1] == inf);
+	CHECK(decoded[2] == -inf);
+	CHECK(decoded[3] == inf);
+
+	// Below the smallest denormal flushes to a signed zero.
+	float tiny[4] = { 1e-10f, -1e-10f, std::ldexp(1.0f, -25), std::ldexp(1.0f, -24) };
+	PackHalf(tiny, color, payload);
+	CHECK(payload.pos[0] == (0x0000u | (0x8000u << 16)));
+	// Exactly half of the smallest denormal rounds to even, which is zero.
+	CHECK(payload.pos[1] == (0x0000u | (0x0001u << 16)));
+
+	float nan[4] = { std::numeric_limits<float>::quiet_NaN(), 0, 0, 0 };
+	PackHalf(nan, color, payload);
+	DecodeHalf(payload, decoded);
+	CHECK(std::isnan(decoded[0]));
+}
+
+static void TestQuantizedRoundTrip()
+{
+	float color[4] = {};
+	float origin[4] = { 10.0f, -20.0f, 5.0f, 0.0f };
+	float extent = 8.0f;
+	PackedPayload payload;
+	float decoded[3];
+
+	// The origin and both ends of the extent are exact.
+	float ends[][4] = { { 10.0f, -20.0f, 5.0f, 1.0f }, { 18.0f, -28.0f, 13.0f, 1.0f }, { 2.0f, -12.0f, -3.0f, 1.0f } };
+	for (auto const & pos : ends)
+	{
+		PackQuantized(pos, color, origin, extent, payload);
+		DecodeQuantized(payload, origin, extent, decoded);
+		for (int j = 0; j < 3; j++)
+			CHECK(std::fabs(decoded[j] - pos[j]) <= 1e-5f);
+	}
+
+	// Within the extent the error is at most half a step, plus what the float math around it loses.
+	float step = extent / 32767.0f;
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> offset(-extent, extent);
+	for (int i = 0; i < 100000; i++)
+	{
+		float pos[4] = { origin[0] + offset(rng), origin[1] + offset(rng), origin[2] + offset(rng), 1.0f };
+		PackQuantized(pos, color, origin, extent, payload);
+		DecodeQuantized(payload, origin, extent, decoded);
+		for (int j = 0; j < 3; j++)
+			CHECK(std::fabs(decoded[j] - pos[j]) <= step * 0.5f + 1e-5f);
+	}
+}
+
+static void TestQuantizedClamp()
+{
+	float color[4] = {};
+	float origin[4] = { 1.0f, 2.0f, 3.0f, 0.0f };
+	float extent = 4.0f;
+	PackedPayload payload;
+	float decoded[3];
+
+	// Positions beyond the extent end up on its border instead of wrapping around.
+	float inf = std::numeric_limits<float>::infinity();
+	float pos[4] = { 100.0f, -100.0f, inf, 1.0f };
+	PackQuantized(pos, color, origin, extent, payload);
+	DecodeQuantized(payload, origin, extent, decoded);
+	CHECK(std::fabs(decoded[0] - 5.0f) <= 1e-5f);
+	CHECK(std::fabs(decoded[1] + 2.0f) <= 1e-5f);
+	CHECK(std::fabs(decoded[2] - 7.0f) <= 1e-5f);
+
+	// -32768 is never used, so the range is symmetric.
+	float below[4] = { -inf, -3.0f, 3.0f - 4.0001f, 0.0f };
+	PackQuantized(below, color, origin, extent, payload);
+	CHECK((payload.pos[0] & 0xffff) == 0x8001u);
+	CHECK((payload.pos[0] >> 16) == 0x8001u);
+	CHECK((payload.pos[1] & 0xffff) == 0x8001u);
+}
+
+static void TestColor()
+{
+	float pos[4] = {};
+	PackedPayload payload;
+	float decoded[4];
+
+	// Out of range channels are clamped.
+	float clamped[4] = { -0.5f, 1.5f, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+	PackHalf(pos, clamped, payload);
+	CHECK(payload.color == 0xff00ff00u);
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> channel(0.0f, 1.0f);
+	for (int i = 0; i < 100000; i++)
+	{
+		float color[4] = { channel(rng), channel(rng), channel(rng), channel(rng) };
+		PackHalf(pos, color, payload);
+		DecodeColor(payload, decoded);
+		for (int j = 0; j < 4; j++)
+			CHECK(std::fabs(decoded[j] - color[j]) <= 0.5f / 255.0f + 1e-6f);
+	}
+
+	// Both encodings share the color.
+	float color[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+	float origin[4] = {};
+	PackedPayload half;
+	PackHalf(pos, color, half);
+	PackQuantized(pos, color, origin, 1.0f, payload);
+	CHECK(half.color == payload.color);
+}
+
+static float RandomFloat(std::mt19937& rng)
+{
+	// Every fourth value is a random bit pattern, which covers NaNs, infinities and denormals.
+	if (rng() % 4 == 0)
+	{
+		std::uint32_t bits = rng();
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	return std::uniform_real_distribution<float>(-70000.0f, 70000.0f)(rng) / static_cast<float>(1u << (rng() % 24));
+}
+
+// The SIMD packers have to produce the same bits as the scalar ones, built with PAYLOAD_PACKING_AVX2.
+static void TestScalarEquivalence()
+{
+	if (!IsPackingVectorized())
+		std::fprintf(stderr, "The packers weren't compiled with SIMD, only the scalar code is tested\n");
+
+	float const edges[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 65504.0f, 65520.0f, -65520.0f, 6.1035156e-05f, 5.9604645e-08f, 2.9802322e-08f,
+		32767.5f, -32767.5f, 1e30f, -1e30f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+		std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::denorm_min() };
+
+	std::mt19937 rng(49);
+	for (std::uint32_t i = 0; i < 1000000; i++)
+	{
+		float pos[4], color[4], origin[4];
+		for (int c = 0; c < 4; c++)
+		{
+			pos[c] = i < 10000 ? edges[rng() % std::size(edges)] : RandomFloat(rng);
+			color[c] = rng() % 2 ? edges[rng() % std::size(edges)] : std::uniform_real_distribution<float>(-0.5f, 1.5f)(rng);
+			origin[c] = std::uniform_real_distribution<float>(-100.0f, 100.0f)(rng);
+		}
+		float extent = std::uniform_real_distribution<float>(0.01f, 1000.0f)(rng);
+
+		PackedPayload simd, scalar;
+		PackHalf(pos, color, simd);
+		PackHalfScalar(pos, color, scalar);
+		CHECK(std::memcmp(&simd, &scalar, sizeof(simd)) == 0);
+
+		PackQuantized(pos, color, origin, extent, simd);
+		PackQuantizedScalar(pos, color, origin, extent, scalar);
+		CHECK(std::memcmp(&simd, &scalar, sizeof(simd)) == 0);
+	}
+}
+
+int main()
+{
+	TestLayout();
+	TestHalfRoundTrip();
+	TestHalfOutOfRange();
+	TestQuantizedRoundTrip();
+	TestQuantizedClamp();
+	TestColor();
+	TestScalarEquivalence();
+	return EXIT_SUCCESS;
+}
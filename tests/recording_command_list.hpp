@@ -0,0 +1,69 @@
+#pragma once
+
+#include "api_interposer.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Command list that records every call it receives instead of executing it.
+class RecordingCommandList : public ID3D12GraphicsCommandList2
+{
+public:
+	struct Command
+	{
+		interposer::Call call;
+		// Root parameter index or the first count argument, 0 if the call has none.
+		UINT idx;
+		// Address, constant, pointer or topology the call set, 0 if the call has none.
+		std::uint64_t value;
+	};
+
+	std::vector<Command> commands;
+	bool closed = false;
+
+	void Clear()
+	{
+		commands.clear();
+		closed = false;
+	}
+
+	std::size_t Count(interposer::Call call) const
+	{
+		std::size_t count = 0;
+		for (auto const & command : commands)
+			count += command.call == call;
+		return count;
+	}
+
+	HRESULT Close() override
+	{
+		closed = true;
+		Add(interposer::Call::Close);
+		return S_OK;
+	}
+
+	void DrawInstanced(UINT vertex_count, UINT, UINT, UINT) override { Add(interposer::Call::DrawInstanced, vertex_count); }
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) override { Add(interposer::Call::IASetPrimitiveTopology, 0, topology); }
+	void RSSetViewports(UINT num, D3D12_VIEWPORT const *) override { Add(interposer::Call::RSSetViewports, num); }
+	void RSSetScissorRects(UINT num, D3D12_RECT const *) override { Add(interposer::Call::RSSetScissorRects, num); }
+	void SetPipelineState(ID3D12PipelineState* pso) override { Add(interposer::Call::SetPipelineState, 0, (std::uintptr_t)pso); }
+	void ResourceBarrier(UINT num, D3D12_RESOURCE_BARRIER const *) override { Add(interposer::Call::ResourceBarrier, num); }
+	void ExecuteBundle(ID3D12GraphicsCommandList* bundle) override { Add(interposer::Call::ExecuteBundle, 0, (std::uintptr_t)bundle); }
+	void SetGraphicsRootSignature(ID3D12RootSignature* root_signature) override { Add(interposer::Call::SetGraphicsRootSignature, 0, (std::uintptr_t)root_signature); }
+	void SetGraphicsRoot32BitConstant(UINT idx, UINT value, UINT) override { Add(interposer::Call::SetGraphicsRoot32BitConstant, idx, value); }
+	void SetGraphicsRootConstantBufferView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address) override { Add(interposer::Call::SetGraphicsRootConstantBufferView, idx, address); }
+	void SetGraphicsRootShaderResourceView(UINT idx, D3D12_GPU_VIRTUAL_ADDRESS address) override { Add(interposer::Call::SetGraphicsRootShaderResourceView, idx, address); }
+	void IASetVertexBuffers(UINT start_slot, UINT num, D3D12_VERTEX_BUFFER_VIEW const * views) override
+	{
+		Add(interposer::Call::IASetVertexBuffers, start_slot, views && num > 0 ? views[0].BufferLocation : 0);
+	}
+	void OMSetRenderTargets(UINT num, D3D12_CPU_DESCRIPTOR_HANDLE const *, BOOL, D3D12_CPU_DESCRIPTOR_HANDLE const *) override { Add(interposer::Call::OMSetRenderTargets, num); }
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, D3D12_RECT const *) override { Add(interposer::Call::ClearDepthStencilView); }
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, FLOAT const [4], UINT, D3D12_RECT const *) override { Add(interposer::Call::ClearRenderTargetView); }
+
+private:
+	void Add(interposer::Call call, UINT idx = 0, std::uint64_t value = 0)
+	{
+		commands.push_back({ call, idx, value });
+	}
+};
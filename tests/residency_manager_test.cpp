@@ -0,0 +1,265 @@
+#include "residency_manager.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <vector>
+
+// Runs the residency policy against a device that only records the calls and reports a fake budget.
+
+class FakeResidencyDevice : public ResidencyDevice
+{
+public:
+	struct Log
+	{
+		std::vector<std::vector<ID3D12Pageable*>> made_resident;
+		std::vector<std::vector<ID3D12Pageable*>> evicted;
+		// Only the queries for the local segment, most tests leave the non-local one to the device.
+		std::size_t budget_queries = 0;
+	};
+
+	// Nothing is in non-local memory unless a test puts it there, so its default budget is never exceeded.
+	FakeResidencyDevice(Log& log, UINT64 budget, UINT64 non_local_budget = 0, HRESULT query_result = S_OK)
+		: log(log), budgets{ budget, non_local_budget }, query_result(query_result) {}
+
+	HRESULT MakeResident(UINT num_objects, ID3D12Pageable* const * objects) override
+	{
+		log.made_resident.emplace_back(objects, objects + num_objects);
+		return S_OK;
+	}
+
+	HRESULT Evict(UINT num_objects, ID3D12Pageable* const * objects) override
+	{
+		log.evicted.emplace_back(objects, objects + num_objects);
+		return S_OK;
+	}
+
+	HRESULT QueryBudget(MemorySegment segment, UINT64& budget) override
+	{
+		if (segment == MemorySegment::Local)
+			log.budget_queries++;
+		budget = budgets[static_cast<std::size_t>(segment)];
+		return query_result;
+	}
+
+private:
+	Log& log;
+	UINT64 budgets[2];
+	HRESULT query_result;
+};
+
+static ID3D12Pageable a, b, c, d;
+
+static void TestEvictsLeastRecentlyUsedFirst()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0), 200);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.Track(&c, 100, MemorySegment::Local);
+	residency.Track(&d, 100, MemorySegment::Local);
+
+	// a becomes the most recently used, b and c are the oldest.
+	residency.MarkUsed(&a, 1);
+	residency.MarkUsed(&d, 1);
+	residency.EnforceBudget(1);
+
+	CHECK(log.evicted.size() == 1);
+	CHECK((log.evicted[0] == std::vector<ID3D12Pageable*>{ &b, &c }));
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 200);
+
+	// Already within budget, nothing to do.
+	residency.EnforceBudget(1);
+	CHECK(log.evicted.size() == 1);
+	CHECK(log.budget_queries == 0);
+}
+
+static void TestKeepsObjectsTheGPUStillUses()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0), 100);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.Track(&c, 100, MemorySegment::Local);
+	residency.MarkUsed(&a, 5);
+	residency.MarkUsed(&b, 6);
+	residency.MarkUsed(&c, 7);
+
+	// Only a's submission has completed, b and c are still in flight even though they are over budget.
+	residency.EnforceBudget(5);
+	CHECK(log.evicted.size() == 1);
+	CHECK((log.evicted[0] == std::vector<ID3D12Pageable*>{ &a }));
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 200);
+
+	residency.EnforceBudget(6);
+	CHECK(log.evicted.size() == 2);
+	CHECK((log.evicted[1] == std::vector<ID3D12Pageable*>{ &b }));
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 100);
+
+	// Nothing completed since, so nothing more can go.
+	residency.EnforceBudget(6);
+	CHECK(log.evicted.size() == 2);
+}
+
+static void TestMarkUsedMakesEvictedObjectsResidentAgain()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0), 100);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.Track(&c, 100, MemorySegment::Local);
+	residency.EnforceBudget(0);
+	CHECK((log.evicted.back() == std::vector<ID3D12Pageable*>{ &a, &b }));
+
+	// Resident objects don't need a call, evicted ones are batched into one.
+	residency.MarkUsed(&a, 1);
+	residency.MarkUsed(&b, 1);
+	residency.MarkUsed(&c, 1);
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 300);
+	CHECK(log.made_resident.empty());
+	residency.MakeUsedResident();
+	CHECK(log.made_resident.size() == 1);
+	CHECK((log.made_resident[0] == std::vector<ID3D12Pageable*>{ &a, &b }));
+
+	residency.MakeUsedResident();
+	CHECK(log.made_resident.size() == 1);
+
+	// Used again, so c is evicted before a and b.
+	residency.MarkUsed(&a, 2);
+	residency.MarkUsed(&b, 2);
+	residency.EnforceBudget(2);
+	CHECK((log.evicted.back() == std::vector<ID3D12Pageable*>{ &c, &a }));
+}
+
+// The app marks what the next frame uses before it enforces the budget. Otherwise its buffers, last used frames_in_flight
+// frames ago, would be the only ones that completed, and would be evicted and made resident again every frame.
+static void TestNextFrameIsMarkedBeforeEnforcing()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0), 200);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.Track(&c, 100, MemorySegment::Local);
+
+	// Two frames in flight, a belongs to the odd frames and b to the even ones, c is used by every frame.
+	for (UINT64 frame = 1; frame <= 10; frame++)
+	{
+		UINT64 completed = frame > 2 ? frame - 2 : 0;
+		residency.MarkUsed(frame % 2 ? &a : &b, frame);
+		residency.MarkUsed(&c, frame);
+		residency.EnforceBudget(completed);
+		residency.MakeUsedResident();
+	}
+
+	// b hadn't been used yet when the first frame ran over the budget. After that every frame needs all of them,
+	// so the budget stays exceeded instead of paging every frame.
+	CHECK(log.evicted.size() == 1);
+	CHECK(log.made_resident.size() == 1);
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 300);
+}
+
+// Upload heaps live in system memory on discrete adapters and don't take video memory from the default heaps.
+static void TestSegmentsHaveTheirOwnBudget()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0, 1000), 100);
+	CHECK(residency.GetBudget(MemorySegment::NonLocal) == 1000);
+	residency.Track(&c, 300, MemorySegment::NonLocal);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+
+	// c is the oldest, but only the local segment is over its budget.
+	residency.EnforceBudget(0);
+	CHECK(log.evicted.size() == 1);
+	CHECK((log.evicted[0] == std::vector<ID3D12Pageable*>{ &a }));
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 100);
+	CHECK(residency.GetResidentBytes(MemorySegment::NonLocal) == 300);
+
+	// Both segments over budget still share a single call.
+	FakeResidencyDevice::Log both_log;
+	ResidencyManager both(std::make_unique<FakeResidencyDevice>(both_log, 0), 100, 100);
+	both.Track(&a, 100, MemorySegment::Local);
+	both.Track(&c, 100, MemorySegment::NonLocal);
+	both.Track(&b, 100, MemorySegment::Local);
+	both.Track(&d, 100, MemorySegment::NonLocal);
+	both.EnforceBudget(0);
+	CHECK(both_log.evicted.size() == 1);
+	CHECK((both_log.evicted[0] == std::vector<ID3D12Pageable*>{ &a, &c }));
+	CHECK(both.GetResidentBytes(MemorySegment::Local) == 100);
+	CHECK(both.GetResidentBytes(MemorySegment::NonLocal) == 100);
+	CHECK(both_log.budget_queries == 0);
+}
+
+static void TestUntrack()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0), 100);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.EnforceBudget(0);
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 100);
+
+	// Evicted objects don't count towards the resident bytes anymore.
+	residency.Untrack(&a);
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 100);
+	residency.Untrack(&b);
+	CHECK(residency.GetResidentBytes(MemorySegment::Local) == 0);
+
+	// A released object must not be made resident.
+	residency.Track(&c, 100, MemorySegment::Local);
+	residency.Track(&d, 100, MemorySegment::Local);
+	residency.EnforceBudget(0);
+	residency.MarkUsed(&c, 1);
+	residency.Untrack(&c);
+	residency.MakeUsedResident();
+	CHECK(log.made_resident.empty());
+
+	residency.MarkUsed(&a, 1);
+	residency.MakeUsedResident();
+	CHECK(log.made_resident.empty());
+}
+
+static void TestBudgetFromDevice()
+{
+	FakeResidencyDevice::Log log;
+	ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 150), 0);
+	CHECK(residency.GetBudget(MemorySegment::Local) == 150);
+	residency.Track(&a, 100, MemorySegment::Local);
+	residency.Track(&b, 100, MemorySegment::Local);
+	residency.EnforceBudget(0);
+	CHECK((log.evicted.back() == std::vector<ID3D12Pageable*>{ &a }));
+
+	// An override doesn't ask the device.
+	FakeResidencyDevice::Log override_log;
+	ResidencyManager overridden(std::make_unique<FakeResidencyDevice>(override_log, 150), 300);
+	CHECK(overridden.GetBudget(MemorySegment::Local) == 300);
+	CHECK(override_log.budget_queries == 0);
+}
+
+static void TestThrowsWithoutBudget()
+{
+	FakeResidencyDevice::Log log;
+	bool thrown = false;
+	try
+	{
+		ResidencyManager residency(std::make_unique<FakeResidencyDevice>(log, 0, 0, E_FAIL), 0);
+	}
+	catch (char const * e)
+	{
+		thrown = std::strlen(e) > 0;
+	}
+	CHECK(thrown);
+	CHECK(log.evicted.empty());
+}
+
+int main()
+{
+	TestEvictsLeastRecentlyUsedFirst();
+	TestKeepsObjectsTheGPUStillUses();
+	TestMarkUsedMakesEvictedObjectsResidentAgain();
+	TestNextFrameIsMarkedBeforeEnforcing();
+	TestSegmentsHaveTheirOwnBudget();
+	TestUntrack();
+	TestBudgetFromDevice();
+	TestThrowsWithoutBudget();
+	return EXIT_SUCCESS;
+}
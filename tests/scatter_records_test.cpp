@@ -0,0 +1,145 @@
+#include "scatter_records.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Stages dirty slots as records and scatters them on the CPU, the way the delta scatter runs without a GPU.
+
+// scatter_compute.hlsl, one loop iteration per thread. Loads and stores whole dwords.
+static void ShaderScatter(std::uint8_t const * records, std::uint32_t record_count, std::uint32_t record_stride, std::uint32_t slot_size,
+	std::uint32_t payload_size, std::uint8_t* slots)
+{
+	for (std::uint32_t thread = 0; thread < record_count; thread++)
+	{
+		std::uint32_t record = thread * record_stride;
+		std::uint32_t slot;
+		std::memcpy(&slot, records + record, 4);
+		slot *= slot_size;
+		for (std::uint32_t i = 0; i < payload_size; i += 4)
+			std::memcpy(slots + slot + i, records + record + 4 + i, 4);
+	}
+}
+
+static void TestRecordLayout()
+{
+	CHECK(GetRecordStride(4) == 8);
+	CHECK(GetRecordStride(6) == 12);
+	CHECK(GetRecordStride(32) == 36);
+
+	std::uint32_t const slot_size = 16, payload_size = 6, num_slots = 4;
+	std::vector<std::uint8_t> shadow(num_slots * slot_size, 0xcd);
+	for (std::uint32_t i = 0; i < payload_size; i++)
+		shadow[2 * slot_size + i] = static_cast<std::uint8_t>(i + 1);
+	std::vector<std::uint8_t> dirty = { 0, 0, 1, 0 };
+
+	std::vector<std::uint8_t> records(GetRecordStride(payload_size), 0xff);
+	std::uint32_t slot = 0;
+	CHECK(WriteRecords(shadow.data(), dirty.data(), 1, num_slots, slot_size, payload_size, slot, 1, records.data()) == 1);
+	CHECK(slot == 3);
+	CHECK(dirty[2] == 0);
+
+	std::uint32_t index;
+	std::memcpy(&index, records.data(), sizeof(index));
+	CHECK(index == 2);
+	for (std::uint32_t i = 0; i < payload_size; i++)
+		CHECK(records[4 + i] == i + 1);
+	// The padding is stored by the shader as well, it must not be garbage from the ring.
+	CHECK(records[10] == 0 && records[11] == 0);
+}
+
+static void TestMatchesShader()
+{
+	std::uint32_t const slot_size = 256, num_slots = 500;
+	std::mt19937 rng(46);
+	for (std::uint32_t payload_size : { 4u, 6u, 32u, 48u })
+	{
+		std::uint32_t stride = GetRecordStride(payload_size);
+		std::vector<std::uint8_t> shadow(num_slots * slot_size);
+		for (auto& byte : shadow)
+			byte = static_cast<std::uint8_t>(rng());
+		std::vector<std::uint8_t> dirty(num_slots);
+		for (auto& d : dirty)
+			d = rng() % 3 == 0;
+
+		auto num_dirty = static_cast<std::uint32_t>(std::count(dirty.begin(), dirty.end(), std::uint8_t(1)));
+		std::vector<std::uint8_t> records((std::size_t)num_dirty * stride);
+		std::uint32_t slot = 0;
+		CHECK(WriteRecords(shadow.data(), dirty.data(), 1, num_slots, slot_size, payload_size, slot, num_dirty, records.data()) == num_dirty);
+
+		std::vector<std::uint8_t> cpu(num_slots * slot_size, 0x11);
+		std::vector<std::uint8_t> gpu(cpu);
+		ScatterRecords(records.data(), num_dirty, stride, payload_size, cpu.data(), slot_size);
+		ShaderScatter(records.data(), num_dirty, stride, slot_size, payload_size, gpu.data());
+		CHECK(cpu == gpu);
+	}
+}
+
+// Two copies of the buffer, flushed in turns with a ring that only holds a few records per dispatch.
+static void TestDeltaUpload()
+{
+	std::uint32_t const slot_size = 256, payload_size = 32, num_slots = 1000, max_records = 7, num_copies = 2;
+	std::uint32_t stride = GetRecordStride(payload_size);
+	std::mt19937 rng(4646);
+
+	std::vector<std::uint8_t> shadow(num_slots * slot_size, 0);
+	// Every copy starts out undefined, so the first flush of each uploads every slot.
+	std::vector<std::uint8_t> dirty(num_slots, (1 << num_copies) - 1);
+	std::vector<std::vector<std::uint8_t>> copies(num_copies, std::vector<std::uint8_t>(num_slots * slot_size, 0xee));
+	std::vector<std::uint8_t> ring(max_records * stride);
+
+	for (std::uint32_t frame = 0; frame < 20; frame++)
+	{
+		// A few objects change every frame, most stay the same.
+		std::uint32_t changed = frame == 0 ? num_slots : rng() % 50;
+		for (std::uint32_t i = 0; i < changed; i++)
+		{
+			std::uint32_t slot = frame == 0 ? i : rng() % num_slots;
+			for (std::uint32_t b = 0; b < payload_size; b++)
+				shadow[slot * slot_size + b] = static_cast<std::uint8_t>(rng());
+			dirty[slot] = (1 << num_copies) - 1;
+		}
+
+		std::uint32_t copy = frame % num_copies;
+		std::uint8_t bit = 1 << copy;
+		auto num_dirty = static_cast<std::uint32_t>(std::count_if(dirty.begin(), dirty.end(), [bit](std::uint8_t d) { return (d & bit) != 0; }));
+
+		std::uint32_t slot = 0, scattered = 0;
+		while (scattered < num_dirty)
+		{
+			std::uint32_t count = (std::min)(num_dirty - scattered, max_records);
+			CHECK(WriteRecords(shadow.data(), dirty.data(), bit, num_slots, slot_size, payload_size, slot, count, ring.data()) == count);
+			ScatterRecords(ring.data(), count, stride, payload_size, copies[copy].data(), slot_size);
+			scattered += count;
+		}
+
+		// The flushed copy is up to date, the other one still has its slots marked.
+		for (std::uint32_t s = 0; s < num_slots; s++)
+		{
+			CHECK(!(dirty[s] & bit));
+			CHECK(std::memcmp(copies[copy].data() + s * slot_size, shadow.data() + s * slot_size, payload_size) == 0);
+			// Past the padded payload the slot is never touched.
+			CHECK(copies[copy][s * slot_size + slot_size - 1] == 0xee);
+		}
+		for (std::uint32_t other = 0; other < num_copies; other++)
+		{
+			if (other == copy)
+				continue;
+			for (std::uint32_t s = 0; s < num_slots; s++)
+			{
+				bool matches = std::memcmp(copies[other].data() + s * slot_size, shadow.data() + s * slot_size, payload_size) == 0;
+				CHECK(matches || (dirty[s] & (1 << other)));
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestRecordLayout();
+	TestMatchesShader();
+	TestDeltaUpload();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// The host tests don't use a framework, a failed check prints where it failed and ends the test with an error.
+#define CHECK(expr) \
+	if (!(expr)) \
+	{ \
+		std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+		std::exit(EXIT_FAILURE); \
+	}
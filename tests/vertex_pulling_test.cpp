@@ -0,0 +1,88 @@
+#include "shader_layout.hpp"
+#include "test.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Packs the structs the way the app uploads them and reads them back the way pulling_vertex.hlsl does.
+
+// VERTEX_STRIDE, INSTANCE_STRIDE and INSTANCE_COLOR_OFFSET, computed like CreatePipelineStateObject does.
+static std::uint32_t const vertex_stride = sizeof(Vertex);
+static std::uint32_t const instance_stride = sizeof(CBPerObject);
+static std::uint32_t const instance_color_offset = offsetof(CBPerObject, color);
+
+// ByteAddressBuffer loads, address has to be 4 byte aligned.
+template <std::size_t count>
+static void Load(std::vector<std::uint8_t> const & buffer, std::uint32_t address, float* out)
+{
+	CHECK(address % 4 == 0);
+	CHECK(address + count * 4 <= buffer.size());
+	for (std::size_t i = 0; i < count; i++)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, buffer.data() + address + i * 4, 4);
+		std::memcpy(&out[i], &bits, 4);
+	}
+}
+
+template <typename T>
+static std::vector<std::uint8_t> Upload(std::vector<T> const & items)
+{
+	std::vector<std::uint8_t> buffer(items.size() * sizeof(T));
+	std::memcpy(buffer.data(), items.data(), buffer.size());
+	return buffer;
+}
+
+static void TestVertices()
+{
+	std::vector<Vertex> vertices;
+	for (int i = 0; i < 8; i++)
+		vertices.emplace_back(DirectX::XMFLOAT3(i * 0.5f, -i * 1.0f, i + 0.25f));
+	auto buffer = Upload(vertices);
+
+	for (std::uint32_t vertex_id = 0; vertex_id < vertices.size(); vertex_id++)
+	{
+		float pos[3];
+		Load<3>(buffer, vertex_id * vertex_stride, pos);
+		CHECK(pos[0] == vertices[vertex_id].pos.x);
+		CHECK(pos[1] == vertices[vertex_id].pos.y);
+		CHECK(pos[2] == vertices[vertex_id].pos.z);
+	}
+}
+
+static void TestInstances()
+{
+	std::vector<CBPerObject> objects(20);
+	for (std::size_t i = 0; i < objects.size(); i++)
+	{
+		float f = static_cast<float>(i);
+		objects[i].pos = { f, f + 1, f + 2, 1 };
+		objects[i].color = { f / 20, 1 - f / 20, 0.5f, 1 };
+	}
+	auto buffer = Upload(objects);
+
+	// A batch starts at instance_base, SV_InstanceID counts from 0 within it.
+	for (std::uint32_t instance_base : { 0u, 7u, 19u })
+	{
+		for (std::uint32_t instance_id = 0; instance_base + instance_id < objects.size(); instance_id++)
+		{
+			std::uint32_t instance = (instance_base + instance_id) * instance_stride;
+			float color[4];
+			Load<4>(buffer, instance + instance_color_offset, color);
+
+			auto const & expected = objects[instance_base + instance_id].color;
+			CHECK(color[0] == expected.x);
+			CHECK(color[1] == expected.y);
+			CHECK(color[2] == expected.z);
+			CHECK(color[3] == expected.w);
+		}
+	}
+}
+
+int main()
+{
+	TestVertices();
+	TestInstances();
+	return EXIT_SUCCESS;
+}